@@ -0,0 +1,127 @@
+#ifndef NMATCH_ALIASES_H
+#define NMATCH_ALIASES_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "tokens.h"
+
+namespace nmatch {
+
+// dictionary mapping alternate spellings of a name (e.g. MUHAMMAD, MAMADOU)
+// to a canonical spelling (MOHAMED), so that names are compared as if
+// written the same way. Spellings are added with add(), then frozen by
+// build() into a trie whose nodes are laid out breadth-first, so that the
+// children of each node are contiguous and sorted by character: looking a
+// token up costs a binary search among the children of one node per
+// character, with no hashing and no allocation
+class alias_trie {
+public:
+  alias_trie() : arena_(1024) {}
+
+  // map `alias` to `canonical`. If an alias is added more than once, the
+  // first mapping is kept
+  void add(token_view alias, token_view canonical) {
+    if (alias.empty() || canonical.empty()) return;
+    pending_.push_back(entry{alias.str(), canonical.str(), pending_.size()});
+  }
+
+  void build() {
+    std::sort(pending_.begin(), pending_.end(), [](const entry& a, const entry& b) {
+      const int cmp = a.alias.compare(b.alias);
+      return cmp != 0 ? cmp < 0 : a.order < b.order;
+    });
+    pending_.erase(std::unique(pending_.begin(), pending_.end(),
+                               [](const entry& a, const entry& b) { return a.alias == b.alias; }),
+                   pending_.end());
+
+    // canonical spellings, each stored once
+    std::unordered_map<token_t, std::int32_t> ids;
+    std::vector<std::int32_t> value(pending_.size());
+    for (std::size_t i = 0; i < pending_.size(); ++i) {
+      auto it = ids.find(pending_[i].canonical);
+      if (it == ids.end()) {
+        it = ids.emplace(pending_[i].canonical, static_cast<std::int32_t>(canonical_.size())).first;
+        canonical_.push_back(arena_.store(pending_[i].canonical.data(), pending_[i].canonical.size()));
+      }
+      value[i] = it->second;
+      if (pending_[i].alias.size() > len_max_) len_max_ = pending_[i].alias.size();
+    }
+
+    // breadth-first, each node covering the range of (sorted) aliases sharing
+    // its prefix of length `depth`
+    struct span { std::size_t lo, hi, depth; };
+    labels_.assign(1, 0);
+    values_.assign(1, -1);
+    first_child_.clear();
+    std::vector<span> queue(1, span{0, pending_.size(), 0});
+    for (std::size_t node = 0; node < queue.size(); ++node) {
+      span s = queue[node];
+      first_child_.push_back(static_cast<std::uint32_t>(labels_.size()));
+      if (s.lo < s.hi && pending_[s.lo].alias.size() == s.depth) values_[node] = value[s.lo++];
+      while (s.lo < s.hi) {
+        const char32_t c = pending_[s.lo].alias[s.depth];
+        std::size_t end = s.lo + 1;
+        while (end < s.hi && pending_[end].alias[s.depth] == c) ++end;
+        labels_.push_back(c);
+        values_.push_back(-1);
+        queue.push_back(span{s.lo, end, s.depth + 1});
+        s.lo = end;
+      }
+    }
+    first_child_.push_back(static_cast<std::uint32_t>(labels_.size()));
+
+    n_aliases_ = pending_.size();
+    std::vector<entry>().swap(pending_);
+  }
+
+  // canonical spelling of `t`, or `t` itself if it is not in the dictionary.
+  // The canonical spelling is stored in the dictionary, which must outlive it
+  token_view canonical(token_view t) const {
+    if (t.size() > len_max_ || first_child_.empty()) return t;
+    std::size_t node = 0;
+    for (char32_t c : t) {
+      const char32_t* lo = labels_.data() + first_child_[node];
+      const char32_t* hi = labels_.data() + first_child_[node + 1];
+      const char32_t* it = std::lower_bound(lo, hi, c);
+      if (it == hi || *it != c) return t;
+      node = static_cast<std::size_t>(it - labels_.data());
+    }
+    return values_[node] < 0 ? t : canonical_[values_[node]];
+  }
+
+  // number of aliases, once built
+  std::size_t size() const { return n_aliases_; }
+
+  bool empty() const { return n_aliases_ == 0; }
+
+private:
+  struct entry {
+    token_t alias;
+    token_t canonical;
+    std::size_t order;
+  };
+
+  std::vector<entry> pending_; // until build()
+
+  // node i has character labels_[i], canonical spelling
+  // canonical_[values_[i]] (if values_[i] >= 0) and children
+  // first_child_[i] to first_child_[i + 1] - 1. Node 0 is the root
+  std::vector<char32_t> labels_;
+  std::vector<std::int32_t> values_;
+  std::vector<std::uint32_t> first_child_;
+
+  token_arena arena_;
+  std::vector<token_view> canonical_;
+  std::size_t len_max_ = 0;
+  std::size_t n_aliases_ = 0;
+};
+
+} // namespace nmatch
+
+#endif
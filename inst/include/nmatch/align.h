@@ -0,0 +1,134 @@
+#ifndef NMATCH_ALIGN_H
+#define NMATCH_ALIGN_H
+
+#include <cstddef>
+#include <vector>
+
+namespace nmatch {
+
+// match details for a single pair of names (see return_full in ?nmatch)
+struct pair_summary {
+  bool valid;
+  int k_x;
+  int k_y;
+  int k_align;
+  int n_match;
+  double dist_total;
+};
+
+// find the best alignment of tokens given the k_x by k_y matrix of token
+// distances (row-major, x tokens on rows). As in the R implementation, the
+// alignment is built sequentially by taking the token pair with the lowest
+// distance, removing the remaining pairs that include either token, and
+// repeating until min(k_x, k_y) pairs are aligned. Ties go to the first pair
+// in row-major order. Pairs are produced one at a time so callers can stop
+// once the outcome they need is known
+class greedy_alignment {
+public:
+  void reset(const double* dist, int k_x, int k_y) {
+    dist_ = dist;
+    k_x_ = k_x;
+    k_y_ = k_y;
+    remaining_ = k_x < k_y ? k_x : k_y;
+    used_x_.assign(k_x, 0);
+    used_y_.assign(k_y, 0);
+  }
+
+  // number of pairs still to be aligned
+  int remaining() const { return remaining_; }
+
+  // bytes of scratch storage held
+  std::size_t capacity_bytes() const { return used_x_.capacity() + used_y_.capacity(); }
+
+  // token indices of the pair aligned by the last call to next()
+  int last_i() const { return last_i_; }
+  int last_j() const { return last_j_; }
+
+  // align the next pair, returning its distance
+  double next() {
+    int best_i = -1, best_j = -1;
+    double best = 0.0;
+    for (int i = 0; i < k_x_; ++i) {
+      if (used_x_[i]) continue;
+      const double* row = dist_ + static_cast<long>(i) * k_y_;
+      for (int j = 0; j < k_y_; ++j) {
+        if (used_y_[j]) continue;
+        if (best_i < 0 || row[j] < best) {
+          best = row[j];
+          best_i = i;
+          best_j = j;
+        }
+      }
+    }
+    used_x_[best_i] = 1;
+    used_y_[best_j] = 1;
+    last_i_ = best_i;
+    last_j_ = best_j;
+    --remaining_;
+    return best;
+  }
+
+private:
+  const double* dist_;
+  int k_x_;
+  int k_y_;
+  int remaining_;
+  int last_i_ = -1;
+  int last_j_ = -1;
+  std::vector<char> used_x_;
+  std::vector<char> used_y_;
+};
+
+// token pairs aligned for successive pairs of names, to explain their
+// summaries: the number of aligned token pairs of each pair of names, and for
+// each token pair, the indices of its tokens (rows and columns of the
+// distance matrix, i.e. tokens then initials) and their distance
+struct alignment_trace {
+  std::vector<int> n_aligned;
+  std::vector<int> x;
+  std::vector<int> y;
+  std::vector<double> dist;
+
+  void add_pair() { n_aligned.push_back(0); }
+
+  // forget all pairs, keeping the storage for reuse
+  void clear() {
+    n_aligned.clear();
+    x.clear();
+    y.clear();
+    dist.clear();
+  }
+
+  void add(int i, int j, double d) {
+    x.push_back(i);
+    y.push_back(j);
+    dist.push_back(d);
+    ++n_aligned.back();
+  }
+};
+
+// summarize the greedy alignment of a k_x by k_y distance matrix, adding the
+// aligned token pairs to `trace` if not null
+inline void align_greedy(const double* dist, int k_x, int k_y, double dist_max,
+                         greedy_alignment& align, pair_summary& out,
+                         alignment_trace* trace = nullptr) {
+  align.reset(dist, k_x, k_y);
+
+  out.valid = true;
+  out.k_x = k_x;
+  out.k_y = k_y;
+  out.k_align = align.remaining();
+  out.n_match = 0;
+  out.dist_total = 0.0;
+
+  while (align.remaining() > 0) {
+    const double d = align.next();
+    out.dist_total += d;
+    if (d <= dist_max) ++out.n_match;
+    if (trace) trace->add(align.last_i(), align.last_j(), d);
+  }
+}
+
+} // namespace nmatch
+
+#endif
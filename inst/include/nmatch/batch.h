@@ -0,0 +1,192 @@
+#ifndef NMATCH_BATCH_H
+#define NMATCH_BATCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "osa.h"
+#include "osa_simd.h"
+#include "tokens.h"
+
+namespace nmatch {
+
+// token distances gathered across many pairs of names and computed together.
+// A single token distance is too small a job to run efficiently on its own,
+// so jobs are bucketed by the lengths of their two tokens, and each bucket is
+// run through a batched kernel (see osa_simd.h) that computes one distance
+// per SIMD lane. Buckets too small to fill half the lanes, tokens longer than
+// osa_batch_max_len and tokens with codepoints beyond U+FFFF are computed with
+// the scalar kernels instead
+class dist_batch {
+public:
+  explicit dist_batch(bool simd = true) {
+    if (simd) kernel_ = osa_batch_default();
+  }
+
+  std::size_t size() const { return jobs_.size(); }
+
+  // bytes of scratch storage held, kept from one batch to the next
+  std::size_t capacity_bytes() const {
+    return tokens_.capacity() * sizeof(packed) + jobs_.capacity() * sizeof(job) +
+      (chars_.capacity() + a_.capacity() + b_.capacity() + out_.capacity()) * sizeof(std::uint16_t) +
+      (key_.capacity() + work_.capacity()) * sizeof(int) + count_.capacity() * sizeof(std::size_t) +
+      order_.capacity() * sizeof(std::uint32_t);
+  }
+
+  // schedule the distances between every token of x and every token of y, to
+  // be written by run() to the row-major k_x by k_y matrix at `out`. The
+  // names must outlive the call to run()
+  void add(const name_tokens& x, const name_tokens& y, double* out) {
+    // a name repeated across pairs (see name_seq) is packed once per batch
+    if (&x != last_x_) {
+      last_x_ = &x;
+      x0_ = static_cast<std::uint32_t>(tokens_.size());
+      for (token_view t : x.tokens) pack(t, x.char_width);
+    }
+    if (&y != last_y_) {
+      last_y_ = &y;
+      y0_ = static_cast<std::uint32_t>(tokens_.size());
+      for (token_view t : y.tokens) pack(t, y.char_width);
+    }
+    const std::uint32_t x0 = x0_, y0 = y0_;
+
+    const int k_x = x.k(), k_y = y.k();
+    std::size_t n = jobs_.size();
+    jobs_.resize(n + static_cast<std::size_t>(k_x) * k_y);
+    for (int i = 0; i < k_x; ++i) {
+      for (int j = 0; j < k_y; ++j) jobs_[n++] = job{x0 + i, y0 + j, out++};
+    }
+  }
+
+  // compute all scheduled distances, capped at bound + 1 if bound >= 0, and
+  // clear the batch. Returns the number of distances cut off at the bound
+  std::size_t run(int bound) {
+    const int cap = bound >= 0 && bound < 0x7FFE ? bound + 1 : 0x7FFF;
+    std::size_t cutoffs = 0;
+
+    // counting sort of the batchable jobs by (na, nb)
+    const int w = osa_batch_max_len + 1;
+    count_.assign(static_cast<std::size_t>(w) * w + 1, 0);
+    key_.resize(jobs_.size());
+    for (std::size_t i = 0; i < jobs_.size(); ++i) {
+      const int na = tokens_[jobs_[i].a].len, nb = tokens_[jobs_[i].b].len;
+      const int k = na > 0 && nb > 0 ? na * w + nb : -1;
+      key_[i] = k;
+      if (k >= 0) ++count_[k + 1];
+      else cutoffs += run_scalar(jobs_[i], bound);
+    }
+    for (std::size_t k = 1; k < count_.size(); ++k) count_[k] += count_[k - 1];
+    order_.resize(count_.back());
+    for (std::size_t i = 0; i < jobs_.size(); ++i) {
+      if (key_[i] >= 0) order_[count_[key_[i]]++] = static_cast<std::uint32_t>(i);
+    }
+
+    // count_[k] is now the end of bucket k
+    std::size_t begin = 0;
+    for (int k = 0; k < w * w; ++k) {
+      const std::size_t end = count_[k];
+      if (end > begin) cutoffs += run_bucket(k / w, k % w, begin, end, cap, bound);
+      begin = end;
+    }
+
+    jobs_.clear();
+    tokens_.clear();
+    chars_.clear();
+    last_x_ = last_y_ = nullptr;
+    return cutoffs;
+  }
+
+private:
+  // a token copied into chars_ as 16-bit code units, with len = 0 if it
+  // can't be batched
+  struct packed {
+    token_view token;
+    std::uint32_t offset;
+    int len;
+  };
+
+  struct job {
+    std::uint32_t a, b; // indices into tokens_
+    double* out;
+  };
+
+  // pack a token of a name whose codepoints fit in `width` bytes (see
+  // name_tokens::char_width): tokens of names within the Basic Multilingual
+  // Plane are copied as they are, and only those of wider names are checked
+  // codepoint by codepoint
+  void pack(token_view t, int width) {
+    packed p{t, static_cast<std::uint32_t>(chars_.size()), 0};
+    const std::size_t n = t.size();
+    if (kernel_.fn && n <= static_cast<std::size_t>(osa_batch_max_len) &&
+        (width <= 2 || char_width(t) <= 2)) {
+      chars_.resize(p.offset + n);
+      std::uint16_t* dst = chars_.data() + p.offset;
+      for (std::size_t i = 0; i < n; ++i) dst[i] = static_cast<std::uint16_t>(t[i]);
+      p.len = static_cast<int>(n);
+    }
+    tokens_.push_back(p);
+  }
+
+  std::size_t run_scalar(const job& j, int bound) {
+    const token_view a = tokens_[j.a].token;
+    const token_view b = tokens_[j.b].token;
+    if (bound < 0) {
+      *j.out = osa_dist(a.data(), a.size(), b.data(), b.size(), work_);
+      return 0;
+    }
+    const int d = osa_dist_bounded(a.data(), a.size(), b.data(), b.size(), bound, work_);
+    *j.out = d;
+    return d > bound;
+  }
+
+  std::size_t run_bucket(int na, int nb, std::size_t begin, std::size_t end, int cap, int bound) {
+    const std::size_t n = end - begin;
+    const std::size_t lanes = static_cast<std::size_t>(kernel_.lanes);
+    std::size_t cutoffs = 0;
+    if (2 * n < lanes) {
+      for (std::size_t i = begin; i < end; ++i) cutoffs += run_scalar(jobs_[order_[i]], bound);
+      return cutoffs;
+    }
+
+    // transpose into position-major lanes, padded to a multiple of the lane
+    // count (padding lanes hold stale characters and their results are unused)
+    const std::size_t stride = (n + lanes - 1) / lanes * lanes;
+    if (a_.size() < na * stride) a_.resize(na * stride);
+    if (b_.size() < nb * stride) b_.resize(nb * stride);
+    if (out_.size() < n) out_.resize(n);
+    for (std::size_t l = 0; l < n; ++l) {
+      const job& j = jobs_[order_[begin + l]];
+      const std::uint16_t* a = chars_.data() + tokens_[j.a].offset;
+      const std::uint16_t* b = chars_.data() + tokens_[j.b].offset;
+      for (int p = 0; p < na; ++p) a_[p * stride + l] = a[p];
+      for (int p = 0; p < nb; ++p) b_[p * stride + l] = b[p];
+    }
+
+    kernel_.fn(a_.data(), b_.data(), na, nb, stride, n, static_cast<std::uint16_t>(cap), out_.data());
+
+    for (std::size_t l = 0; l < n; ++l) {
+      *jobs_[order_[begin + l]].out = out_[l];
+      cutoffs += bound >= 0 && out_[l] > bound;
+    }
+    return cutoffs;
+  }
+
+  osa_batch_kernel kernel_ = {"none", 1, nullptr};
+  std::vector<packed> tokens_;
+  std::vector<std::uint16_t> chars_;
+  const name_tokens* last_x_ = nullptr; // names last packed, and their first token
+  const name_tokens* last_y_ = nullptr;
+  std::uint32_t x0_ = 0;
+  std::uint32_t y0_ = 0;
+  std::vector<job> jobs_;
+  std::vector<int> key_;
+  std::vector<std::size_t> count_;
+  std::vector<std::uint32_t> order_;
+  std::vector<std::uint16_t> a_, b_, out_;
+  std::vector<int> work_;
+};
+
+} // namespace nmatch
+
+#endif
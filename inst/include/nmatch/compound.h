@@ -0,0 +1,208 @@
+#ifndef NMATCH_COMPOUND_H
+#define NMATCH_COMPOUND_H
+
+#include <cstddef>
+#include <vector>
+
+#include "align.h"
+#include "tokens.h"
+
+namespace nmatch {
+
+// a run of adjacent tokens of one name, merged into a compound token (e.g.
+// JEAN MARIE -> JEANMARIE) and aligned with a single token of the other name
+struct compound_merge {
+  bool x_side;   // whether the run is in x (partner in y) or in y
+  int start;
+  int width;
+  int partner;
+  double dist;
+};
+
+// alignment of names allowing runs of up to merge_max adjacent tokens on
+// either side to be merged and aligned with a single token of the other name,
+// for names split differently by the tokenizer (JEAN MARIE vs JEANMARIE,
+// KNOWLES-CARTER vs KNOWLESCARTER). A merge is only kept if the compound
+// token matches its partner (distance <= dist_max).
+//
+// Runs are chosen on each side in turn by a dynamic program over token
+// positions: best[i] is the best set of non-overlapping runs among tokens
+// [i, k), taking the most merges and then the lowest summed distance. Merges
+// on x are chosen first, then merges on y among the tokens still free. The
+// tokens left over are aligned greedily, reusing their already-computed
+// distance matrix, so compound distances are the only extra work
+class compound_alignment {
+public:
+  const std::vector<compound_merge>& merges() const { return merges_; }
+
+  // bytes of scratch storage held
+  std::size_t capacity_bytes() const {
+    return merges_.capacity() * sizeof(compound_merge) +
+      used_x_.capacity() + used_y_.capacity() + align_.capacity_bytes() +
+      (rows_.capacity() + cols_.capacity() + cand_partner_.capacity() + best_n_.capacity() +
+       choice_.capacity()) * sizeof(int) +
+      (rest_dist_.capacity() + dists_.capacity() + cand_dist_.capacity() + best_d_.capacity()) * sizeof(double) +
+      run_.capacity() * sizeof(char32_t) + ends_.capacity() * sizeof(std::size_t);
+  }
+
+  // given the k_x by k_y distance matrix of x and y and its greedy summary
+  // `out`, replace `out` with the summary of the best merged alignment if
+  // that has more matching tokens. Compound distances come from
+  // f(run, ends, n_ends, token, dists), which must write to dists[k] the
+  // distance between run[0, ends[k]) and token, or any value above dist_max
+  // if they cannot match. Returns whether `out` was replaced
+  template <typename F>
+  bool apply(const name_tokens& x, const name_tokens& y, const double* dist,
+             int merge_max, double dist_max, F f, pair_summary& out) {
+    merges_.clear();
+    // the merged k_align is at most the original, so merging cannot add
+    // matches to a pair whose aligned tokens all match
+    if (merge_max < 2 || !out.valid || out.n_match >= out.k_align) return false;
+
+    const int k_x = x.k(), k_y = y.k();
+    used_x_.assign(k_x, 0);
+    used_y_.assign(k_y, 0);
+    select(x, y, used_x_, used_y_, true, merge_max, dist_max, f);
+    select(y, x, used_y_, used_x_, false, merge_max, dist_max, f);
+    if (merges_.empty()) return false;
+
+    // greedy alignment of the tokens not involved in a merge
+    rows_.clear();
+    cols_.clear();
+    for (int i = 0; i < k_x; ++i) if (!used_x_[i]) rows_.push_back(i);
+    for (int j = 0; j < k_y; ++j) if (!used_y_[j]) cols_.push_back(j);
+    const int n_rows = static_cast<int>(rows_.size()), n_cols = static_cast<int>(cols_.size());
+    rest_dist_.resize(static_cast<std::size_t>(n_rows) * n_cols);
+    for (int r = 0; r < n_rows; ++r) {
+      for (int c = 0; c < n_cols; ++c) {
+        rest_dist_[static_cast<std::size_t>(r) * n_cols + c] =
+          dist[static_cast<std::size_t>(rows_[r]) * k_y + cols_[c]];
+      }
+    }
+
+    pair_summary rest;
+    if (n_rows > 0 && n_cols > 0) {
+      align_greedy(rest_dist_.data(), n_rows, n_cols, dist_max, align_, rest);
+    } else {
+      rest.n_match = 0;
+      rest.dist_total = 0.0;
+    }
+
+    const int n_merges = static_cast<int>(merges_.size());
+    if (n_merges + rest.n_match <= out.n_match) {
+      merges_.clear();
+      return false;
+    }
+
+    out.k_x = n_merges + n_rows;
+    out.k_y = n_merges + n_cols;
+    out.k_align = n_merges + (n_rows < n_cols ? n_rows : n_cols);
+    out.n_match = n_merges + rest.n_match;
+    out.dist_total = rest.dist_total;
+    for (const compound_merge& m : merges_) out.dist_total += m.dist;
+    return true;
+  }
+
+private:
+  // choose merges of runs of free tokens of s, each aligned with a free token
+  // of o, and mark their tokens as used
+  template <typename F>
+  void select(const name_tokens& s, const name_tokens& o, std::vector<char>& used_s,
+              std::vector<char>& used_o, bool x_side, int merge_max, double dist_max, F& f) {
+    const int k = s.k(), k_o = o.k();
+    if (k < 2) return;
+    if (merge_max > k) merge_max = k;
+
+    // best partner of each run [i, i + w), indexed by i * merge_max + w - 1
+    const std::size_t n_cand = static_cast<std::size_t>(k) * merge_max;
+    cand_partner_.assign(n_cand, -1);
+    cand_dist_.resize(n_cand);
+
+    for (int i = 0; i + 1 < k; ++i) {
+      if (used_s[i]) continue;
+      run_.clear();
+      ends_.clear();
+      run_.append(s.tokens[i].data(), s.tokens[i].size());
+      for (int w = 2; w <= merge_max && i + w <= k && !used_s[i + w - 1]; ++w) {
+        run_.append(s.tokens[i + w - 1].data(), s.tokens[i + w - 1].size());
+        ends_.push_back(run_.size());
+      }
+      const int n_ends = static_cast<int>(ends_.size());
+      if (n_ends == 0) continue;
+      dists_.resize(n_ends);
+
+      for (int j = 0; j < k_o; ++j) {
+        if (used_o[j]) continue;
+        f(run_.data(), ends_.data(), n_ends, o.tokens[j], dists_.data());
+        for (int e = 0; e < n_ends; ++e) {
+          // ends_[e] closes the run of width e + 2
+          const std::size_t c = static_cast<std::size_t>(i) * merge_max + e + 1;
+          if (dists_[e] <= dist_max && (cand_partner_[c] < 0 || dists_[e] < cand_dist_[c])) {
+            cand_partner_[c] = j;
+            cand_dist_[c] = dists_[e];
+          }
+        }
+      }
+    }
+
+    // best_n_[i], best_d_[i]: most merges and their lowest summed distance
+    // among tokens [i, k); choice_[i] is the width of the run starting at i,
+    // or 1 if token i is left unmerged
+    best_n_.assign(k + 1, 0);
+    best_d_.assign(k + 1, 0.0);
+    choice_.assign(k, 1);
+    for (int i = k - 1; i >= 0; --i) {
+      best_n_[i] = best_n_[i + 1];
+      best_d_[i] = best_d_[i + 1];
+      for (int w = 2; w <= merge_max && i + w <= k; ++w) {
+        const std::size_t c = static_cast<std::size_t>(i) * merge_max + w - 1;
+        if (cand_partner_[c] < 0) continue;
+        const int n = 1 + best_n_[i + w];
+        const double d = cand_dist_[c] + best_d_[i + w];
+        if (n > best_n_[i] || (n == best_n_[i] && d < best_d_[i])) {
+          best_n_[i] = n;
+          best_d_[i] = d;
+          choice_[i] = w;
+        }
+      }
+    }
+
+    // runs are chosen independently of one another's partners, so a run
+    // whose partner is already taken by an earlier run is left unmerged
+    for (int i = 0; i < k;) {
+      const int w = choice_[i];
+      if (w > 1) {
+        const std::size_t c = static_cast<std::size_t>(i) * merge_max + w - 1;
+        const int j = cand_partner_[c];
+        if (!used_o[j]) {
+          used_o[j] = 1;
+          for (int t = i; t < i + w; ++t) used_s[t] = 1;
+          merges_.push_back(compound_merge{x_side, i, w, j, cand_dist_[c]});
+          i += w;
+          continue;
+        }
+      }
+      ++i;
+    }
+  }
+
+  std::vector<compound_merge> merges_;
+  std::vector<char> used_x_;
+  std::vector<char> used_y_;
+  std::vector<int> rows_;
+  std::vector<int> cols_;
+  std::vector<double> rest_dist_;
+  greedy_alignment align_;
+  token_t run_;
+  std::vector<std::size_t> ends_;
+  std::vector<double> dists_;
+  std::vector<int> cand_partner_;
+  std::vector<double> cand_dist_;
+  std::vector<int> best_n_;
+  std::vector<double> best_d_;
+  std::vector<int> choice_;
+};
+
+} // namespace nmatch
+
+#endif
@@ -0,0 +1,731 @@
+#ifndef NMATCH_ENGINE_H
+#define NMATCH_ENGINE_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "align.h"
+#include "batch.h"
+#include "compound.h"
+#include "eval.h"
+#include "jaro.h"
+#include "osa.h"
+#include "profile.h"
+#include "tokens.h"
+#include "weighted.h"
+
+namespace nmatch {
+
+// token distance methods. Codes must match dist_methods_native in R/utils.R
+enum dist_method {
+  DIST_OSA = 1,
+  DIST_JW = 2,
+  DIST_WOSA = 3
+};
+
+// per-call matching parameters
+struct match_params {
+  double dist_max;
+  bool simd = true;              // batch token distances across pairs (see batch.h)
+  dist_method method = DIST_OSA;
+  double jw_p = 0.0;             // Winkler prefix factor for DIST_JW
+  const edit_costs* costs = nullptr; // operation costs for DIST_WOSA (see weighted.h)
+  int merge_max = 1;             // widest run of tokens merged into one (see compound.h)
+  double initial_cost = 0.0;     // distance between an initial and a token it abbreviates
+};
+
+// work counters, accumulated across pairs
+struct match_counters {
+  std::uint64_t pairs = 0;             // pairs of names compared
+  std::uint64_t exact = 0;             // pairs resolved by equal token sets
+  std::uint64_t token_comparisons = 0; // token distances computed
+  std::uint64_t dist_cutoffs = 0;      // token distances cut off at the bound
+  std::uint64_t exit_tokens = 0;       // pairs decided from token counts alone
+  std::uint64_t exit_matrix = 0;       // pairs decided before the full distance matrix
+  std::uint64_t exit_align = 0;        // pairs decided before the full alignment
+  std::uint64_t merges = 0;            // pairs aligned with merged tokens
+
+  match_counters& operator+=(const match_counters& other) {
+    pairs += other.pairs;
+    exact += other.exact;
+    token_comparisons += other.token_comparisons;
+    dist_cutoffs += other.dist_cutoffs;
+    exit_tokens += other.exit_tokens;
+    exit_matrix += other.exit_matrix;
+    exit_align += other.exit_align;
+    merges += other.merges;
+    return *this;
+  }
+};
+
+// computes match summaries for pairs of tokenized names. Scratch buffers are
+// kept across calls so a single matcher can be reused for every pair; when
+// comparing in parallel, each thread needs its own matcher
+class matcher {
+public:
+  explicit matcher(const match_params& params) : params_(params), batch_(params.simd) {}
+
+  const match_counters& counters() const { return counters_; }
+
+  // time stages and track buffer growth into `profile` (null to disable)
+  void set_profile(match_profile* profile) { profile_ = profile; }
+
+  // record the token pairs aligned by summarize() and summarize_block() into
+  // `trace` (null to disable), one entry per pair summarized. Alignments with
+  // merged tokens (merge_max > 1) are traced before merging
+  void set_trace(alignment_trace* trace) { trace_ = trace; }
+
+  void summarize(const name_tokens& x, const name_tokens& y, pair_summary& out) {
+    ++counters_.pairs;
+    if (trace_) trace_->add_pair();
+    if (!x.valid() || !y.valid()) {
+      out.valid = false;
+      return;
+    }
+
+    if (exact_match(x, y, out)) {
+      trace_exact(x, y);
+      return;
+    }
+
+    fill_dist(x, y);
+
+    stage_timer t(profile_, STAGE_ALIGN);
+    align_pair(x, y, dist_.data(), out);
+  }
+
+  // distances of the aligned token pairs, in the order they were aligned (i.e.
+  // ascending). The greedy alignment does not depend on dist_max, so these are
+  // all that is needed to re-evaluate a pair under different thresholds.
+  // Returns false if the pair has no valid summary
+  bool aligned_dists(const name_tokens& x, const name_tokens& y, std::vector<double>& out) {
+    ++counters_.pairs;
+    out.clear();
+    if (!x.valid() || !y.valid()) return false;
+
+    if (x.same_tokens(y)) {
+      ++counters_.exact;
+      out.assign(x.k(), 0.0);
+      return true;
+    }
+
+    const int k_x = x.k(), k_y = y.k();
+    fill_dist(x, y);
+
+    stage_timer t(profile_, STAGE_ALIGN);
+    align_.reset(dist_.data(), k_x, k_y);
+    while (align_.remaining() > 0) out.push_back(align_.next());
+    return true;
+  }
+
+  // summarize pairs x[i], y[i] for i in [0, n). Token distances for the whole
+  // block are gathered into a single batch, so that distances from different
+  // pairs are computed side by side in SIMD lanes
+  void summarize_block(name_seq x, name_seq y, std::size_t n, pair_summary* out) {
+    scratch_watch w(*this);
+    if (!batched()) {
+      hold_patterns(y);
+      for (std::size_t i = 0; i < n; ++i) summarize(x[i], y[i], out[i]);
+      release_patterns();
+      return;
+    }
+
+    std::size_t total = 0;
+    offset_.assign(n, no_dist);
+    for (std::size_t i = 0; i < n; ++i) {
+      ++counters_.pairs;
+      if (!x[i].valid() || !y[i].valid()) {
+        out[i].valid = false;
+      } else if (!exact_match(x[i], y[i], out[i])) {
+        offset_[i] = total;
+        total += static_cast<std::size_t>(x[i].k()) * y[i].k();
+      }
+    }
+
+    fill_dist_block(x, y, n, total, -1);
+
+    stage_timer t(profile_, STAGE_ALIGN);
+    for (std::size_t i = 0; i < n; ++i) {
+      if (trace_) trace_->add_pair();
+      if (offset_[i] == no_dist) {
+        if (out[i].valid) trace_exact(x[i], y[i]);
+        continue;
+      }
+      align_pair(x[i], y[i], dist_.data() + offset_[i], out[i]);
+    }
+  }
+
+  // aligned_dists() for pairs x[i], y[i] in [0, n), with token distances
+  // computed in a single batch as in summarize_block(). Calls f(i, valid,
+  // dists) for each pair in turn
+  template <typename F>
+  void aligned_dists_block(name_seq x, name_seq y, std::size_t n, F f) {
+    scratch_watch w(*this);
+    if (!batched()) {
+      hold_patterns(y);
+      for (std::size_t i = 0; i < n; ++i) {
+        const bool valid = aligned_dists(x[i], y[i], aligned_);
+        f(i, valid, aligned_);
+      }
+      release_patterns();
+      return;
+    }
+
+    std::size_t total = 0;
+    offset_.assign(n, no_dist);
+    for (std::size_t i = 0; i < n; ++i) {
+      ++counters_.pairs;
+      if (!x[i].valid() || !y[i].valid()) continue;
+      if (x[i].same_tokens(y[i])) {
+        ++counters_.exact;
+        continue;
+      }
+      offset_[i] = total;
+      total += static_cast<std::size_t>(x[i].k()) * y[i].k();
+    }
+
+    fill_dist_block(x, y, n, total, -1);
+
+    stage_timer t(profile_, STAGE_ALIGN);
+    for (std::size_t i = 0; i < n; ++i) {
+      aligned_.clear();
+      const bool valid = x[i].valid() && y[i].valid();
+      if (offset_[i] != no_dist) {
+        align_.reset(dist_.data() + offset_[i], x[i].k(), y[i].k());
+        while (align_.remaining() > 0) aligned_.push_back(align_.next());
+      } else if (valid) {
+        aligned_.assign(x[i].k(), 0.0);
+      }
+      f(i, valid, aligned_);
+    }
+  }
+
+  // classify a pair under `rule`, doing only as much work as needed to
+  // decide the outcome. Gives the same result as rule(summary) but:
+  // - token distances are capped just above the relevant threshold (dist_max,
+  //   or the dist_total bound for RULE_MAX_DIST), since the ordering of larger
+  //   distances cannot change the outcome
+  // - for threshold rules, the distance matrix is abandoned once too few rows
+  //   remain to reach the required n_match, and the alignment stops once the
+  //   threshold is reached, out of reach, or only non-matching pairs remain
+  // With merge_max > 1 or initials, the alignment is not over the token
+  // distance matrix alone, so pairs are summarized in full before classifying
+  bool is_match(const name_tokens& x, const name_tokens& y, const eval_rule& rule) {
+    if (params_.merge_max > 1 || has_initials(x, y)) {
+      summarize(x, y, summary_);
+      return rule(summary_);
+    }
+    ++counters_.pairs;
+    if (!x.valid() || !y.valid()) return false;
+    if (exact_match(x, y, summary_)) return rule(summary_);
+
+    const int k_x = x.k(), k_y = y.k();
+    const bool by_threshold = rule.uses_threshold();
+    const int threshold = rule.n_match_threshold(k_x, k_y);
+    const int k_align = k_x < k_y ? k_x : k_y;
+
+    if (by_threshold && (threshold <= 0 || threshold > k_align)) {
+      ++counters_.exit_tokens;
+      return threshold <= 0;
+    }
+
+    const double cutoff = by_threshold ? params_.dist_max : rule.param;
+    if (!fill_dist_bounded(x, y, cutoff, by_threshold ? threshold : 0)) return false;
+
+    stage_timer t(profile_, STAGE_ALIGN);
+    return classify_aligned(dist_.data(), k_x, k_y, rule, threshold);
+  }
+
+  // is_match() for pairs x[i], y[i] in [0, n), writing results to out. Pairs
+  // that can be decided from their tokens alone are resolved first, and the
+  // token distances of the rest computed in a single batch, capped as in
+  // is_match(). Distance matrices are computed in full, so unlike is_match()
+  // no pair exits before the alignment stage
+  void is_match_block(name_seq x, name_seq y, std::size_t n, const eval_rule& rule, int* out) {
+    scratch_watch w(*this);
+    if (params_.merge_max > 1) {
+      summaries_.resize(n);
+      summarize_block(x, y, n, summaries_.data());
+      for (std::size_t i = 0; i < n; ++i) out[i] = rule(summaries_[i]);
+      return;
+    }
+    if (!batched()) {
+      hold_patterns(y);
+      for (std::size_t i = 0; i < n; ++i) out[i] = is_match(x[i], y[i], rule);
+      release_patterns();
+      return;
+    }
+
+    const bool by_threshold = rule.uses_threshold();
+    std::size_t total = 0;
+    offset_.assign(n, no_dist);
+    for (std::size_t i = 0; i < n; ++i) {
+      if (has_initials(x[i], y[i])) {
+        out[i] = is_match(x[i], y[i], rule);
+        continue;
+      }
+      ++counters_.pairs;
+      if (!x[i].valid() || !y[i].valid()) {
+        out[i] = false;
+        continue;
+      }
+      if (exact_match(x[i], y[i], summary_)) {
+        out[i] = rule(summary_);
+        continue;
+      }
+      const int k_x = x[i].k(), k_y = y[i].k();
+      const int threshold = rule.n_match_threshold(k_x, k_y);
+      const int k_align = k_x < k_y ? k_x : k_y;
+      if (by_threshold && (threshold <= 0 || threshold > k_align)) {
+        ++counters_.exit_tokens;
+        out[i] = threshold <= 0;
+        continue;
+      }
+      offset_[i] = total;
+      total += static_cast<std::size_t>(k_x) * k_y;
+    }
+
+    const int bound = dist_bound(by_threshold ? params_.dist_max : rule.param);
+    fill_dist_block(x, y, n, total, bound);
+
+    stage_timer t(profile_, STAGE_ALIGN);
+    for (std::size_t i = 0; i < n; ++i) {
+      if (offset_[i] == no_dist) continue;
+      const int k_x = x[i].k(), k_y = y[i].k();
+      out[i] = classify_aligned(dist_.data() + offset_[i], k_x, k_y, rule,
+                                rule.n_match_threshold(k_x, k_y));
+    }
+  }
+
+  // whether tokens a and b match (distance <= dist_max), computing the
+  // distance only as far as needed to tell
+  bool token_match(token_view a, token_view b) {
+    ++counters_.token_comparisons;
+    const double cutoff = params_.dist_max;
+    switch (params_.method) {
+    case DIST_JW:
+      if (jaro_winkler_lower_bound(a.size(), b.size(), params_.jw_p) > cutoff) return false;
+      return jaro_winkler_dist(a.data(), a.size(), b.data(), b.size(), params_.jw_p, work_) <= cutoff;
+    case DIST_WOSA:
+      return weighted_dist(a.data(), a.size(), b.data(), b.size(), *params_.costs, cutoff, wwork_, work_) <= cutoff;
+    default:
+      if (cutoff < 0) return false;
+      return osa_dist_bounded(a.data(), a.size(), b.data(), b.size(), dist_bound(cutoff), work_) <= cutoff;
+    }
+  }
+
+private:
+  static constexpr std::size_t no_dist = static_cast<std::size_t>(-1);
+
+  // greedy alignment of a (capped) distance matrix, stopping as soon as the
+  // outcome under `rule` is decided
+  bool classify_aligned(const double* dist, int k_x, int k_y, const eval_rule& rule, int threshold) {
+    const bool by_threshold = rule.uses_threshold();
+    align_.reset(dist, k_x, k_y);
+    int n_match = 0;
+    double dist_total = 0.0;
+    while (align_.remaining() > 0) {
+      const double d = align_.next();
+      const bool more = align_.remaining() > 0;
+      if (by_threshold) {
+        if (d <= params_.dist_max) {
+          if (++n_match >= threshold) {
+            counters_.exit_align += more;
+            return true;
+          }
+        } else {
+          // pairs come in order of distance, so no further pair matches
+          counters_.exit_align += more;
+          return false;
+        }
+        if (n_match + align_.remaining() < threshold) {
+          counters_.exit_align += more;
+          return false;
+        }
+      } else {
+        dist_total += d;
+        if (dist_total > rule.param) {
+          counters_.exit_align += more;
+          return false;
+        }
+      }
+    }
+
+    return by_threshold ? n_match >= threshold : dist_total <= rule.param;
+  }
+
+  // names with identical token sets (e.g. the same name in a different order)
+  // align every token with itself at distance 0, so their summary is known
+  // without computing any distances
+  bool exact_match(const name_tokens& x, const name_tokens& y, pair_summary& out) {
+    if (params_.dist_max < 0 || !x.same_tokens(y)) return false;
+    ++counters_.exact;
+    out.valid = true;
+    out.k_x = out.k_y = out.k_align = out.n_match = x.k() + x.n_initials();
+    out.dist_total = 0.0;
+    return true;
+  }
+
+  // trace the alignment of names with the same token set, where each token
+  // and initial is aligned with itself
+  void trace_exact(const name_tokens& x, const name_tokens& y) {
+    if (!trace_) return;
+    const int k_x = x.k(), k_y = y.k();
+    for (int i = 0; i < k_x; ++i) {
+      const int j = static_cast<int>(std::find(y.tokens.begin(), y.tokens.end(), x.tokens[i]) - y.tokens.begin());
+      trace_->add(i, j, 0.0);
+    }
+    for (int r = 0; r < x.n_initials(); ++r) trace_->add(k_x + r, k_y + r, 0.0);
+  }
+
+  // full k_x by k_y matrix of token distances
+  void fill_dist(const name_tokens& x, const name_tokens& y) {
+    stage_timer t(profile_, STAGE_DISTANCE);
+    const int k_x = x.k(), k_y = y.k();
+    resize_dist(static_cast<std::size_t>(k_x) * k_y);
+    set_patterns(y);
+    if (x.char_width == 1 && y.char_width == 1) fill_dist_units<unsigned char>(x, y);
+    else fill_dist_units<char32_t>(x, y);
+    clear_patterns(y);
+    counters_.token_comparisons += static_cast<std::uint64_t>(k_x) * k_y;
+  }
+
+  // fill_dist() comparing the tokens as code units of type C (see
+  // name_tokens::units())
+  template <typename C>
+  void fill_dist_units(const name_tokens& x, const name_tokens& y) {
+    const int k_x = x.k(), k_y = y.k();
+    std::size_t off_a = 0;
+    for (int i = 0; i < k_x; ++i) {
+      const std::size_t na = x.tokens[i].size();
+      const C* a = x.units<C>(i, off_a);
+      std::size_t off_b = 0;
+      for (int j = 0; j < k_y; ++j) {
+        const std::size_t nb = y.tokens[j].size();
+        dist_[static_cast<std::size_t>(i) * k_y + j] = token_dist(a, na, y.units<C>(j, off_b), nb, j);
+        off_b += nb;
+      }
+      off_a += na;
+    }
+  }
+
+  // matrix of token distances, with distances that must exceed `cutoff`
+  // replaced by some other value above it: OSA distances are capped at
+  // floor(cutoff) + 1, weighted distances at cutoff + 1, and Jaro-Winkler
+  // distances whose lower bound from token lengths alone is above the cutoff
+  // are set to 1. Rows are filled in turn, stopping (and returning false) once
+  // fewer than `threshold` rows can contain a matching token
+  bool fill_dist_bounded(const name_tokens& x, const name_tokens& y, double cutoff, int threshold) {
+    stage_timer t(profile_, STAGE_DISTANCE);
+    resize_dist(static_cast<std::size_t>(x.k()) * y.k());
+    set_patterns(y);
+    const bool complete = x.char_width == 1 && y.char_width == 1
+      ? fill_dist_bounded_units<unsigned char>(x, y, cutoff, threshold)
+      : fill_dist_bounded_units<char32_t>(x, y, cutoff, threshold);
+    clear_patterns(y);
+    return complete;
+  }
+
+  // fill_dist_bounded() comparing the tokens as code units of type C
+  template <typename C>
+  bool fill_dist_bounded_units(const name_tokens& x, const name_tokens& y, double cutoff, int threshold) {
+    const int k_x = x.k(), k_y = y.k();
+    const int bound = dist_bound(cutoff);
+    int rows_matching = 0;
+    std::size_t off_a = 0;
+    for (int i = 0; i < k_x; ++i) {
+      const std::size_t na = x.tokens[i].size();
+      const C* a = x.units<C>(i, off_a);
+      double* row = dist_.data() + static_cast<std::size_t>(i) * k_y;
+      bool row_matching = false;
+      std::size_t off_b = 0;
+      for (int j = 0; j < k_y; ++j) {
+        const std::size_t nb = y.tokens[j].size();
+        const C* b = y.units<C>(j, off_b);
+        off_b += nb;
+        double d;
+        if (params_.method == DIST_JW) {
+          if (jaro_winkler_lower_bound(na, nb, params_.jw_p) > cutoff) {
+            ++counters_.dist_cutoffs;
+            d = 1.0;
+          } else {
+            d = token_dist(a, na, b, nb, j);
+          }
+        } else if (params_.method == DIST_WOSA) {
+          d = weighted_dist(a, na, b, nb, *params_.costs, cutoff, wwork_, work_);
+          if (d > cutoff) ++counters_.dist_cutoffs;
+        } else {
+          d = osa_dist_bounded(a, na, b, nb, bound, work_);
+          if (d > bound) ++counters_.dist_cutoffs;
+        }
+        row[j] = d;
+        row_matching = row_matching || d <= params_.dist_max;
+      }
+      off_a += na;
+      counters_.token_comparisons += k_y;
+      rows_matching += row_matching;
+      if (rows_matching + (k_x - 1 - i) < threshold) {
+        if (i < k_x - 1) ++counters_.exit_matrix;
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // distance between token a and token j of y, b (whose pattern must be set
+  // for Jaro-Winkler)
+  template <typename C>
+  double token_dist(const C* a, std::size_t na, const C* b, std::size_t nb, int j) {
+    if (params_.method == DIST_OSA) return osa_dist(a, na, b, nb, work_);
+    if (params_.method == DIST_WOSA) return weighted_dist(a, na, b, nb, *params_.costs, -1.0, wwork_, work_);
+    if (na > static_cast<std::size_t>(jw_bitpar_max_len) || nb > static_cast<std::size_t>(jw_bitpar_max_len)) {
+      return jaro_winkler_dist(a, na, b, nb, params_.jw_p, work_);
+    }
+    return jaro_winkler_dist(a, na, patterns_[j], b, nb, params_.jw_p);
+  }
+
+  // bit-parallel Jaro-Winkler looks up the characters of x tokens in
+  // patterns of the y tokens, built once per pair, or once per block when
+  // held for a y name repeated across the block (see hold_patterns())
+  void set_patterns(const name_tokens& y) {
+    if (params_.method != DIST_JW || patterns_of_ == &y) return;
+    if (patterns_of_) release(*patterns_of_);
+    if (patterns_.size() < y.tokens.size()) patterns_.resize(y.tokens.size());
+    for (std::size_t j = 0; j < y.tokens.size(); ++j) {
+      const token_view b = y.tokens[j];
+      if (b.size() <= static_cast<std::size_t>(jw_bitpar_max_len)) patterns_[j].set(b.data(), b.size());
+    }
+    patterns_of_ = &y;
+  }
+
+  void clear_patterns(const name_tokens& y) {
+    if (patterns_of_ == &y && !hold_patterns_) release(y);
+  }
+
+  void release(const name_tokens& y) {
+    for (std::size_t j = 0; j < y.tokens.size(); ++j) {
+      const token_view b = y.tokens[j];
+      if (b.size() <= static_cast<std::size_t>(jw_bitpar_max_len)) patterns_[j].clear(b.data(), b.size());
+    }
+    patterns_of_ = nullptr;
+  }
+
+  // keep the patterns of a repeated y name set from one pair to the next,
+  // until release_patterns()
+  void hold_patterns(name_seq y) { hold_patterns_ = y.repeated(); }
+
+  void release_patterns() {
+    hold_patterns_ = false;
+    if (patterns_of_) release(*patterns_of_);
+  }
+
+  static bool has_initials(const name_tokens& x, const name_tokens& y) {
+    return (x.initials | y.initials) != 0;
+  }
+
+  // summarize a pair from its k_x by k_y matrix of token distances
+  void align_pair(const name_tokens& x, const name_tokens& y, const double* dist, pair_summary& out) {
+    if (has_initials(x, y)) {
+      align_initials(x, y, dist, out);
+      return;
+    }
+    align_greedy(dist, x.k(), y.k(), params_.dist_max, align_, out, trace_);
+    merge_tokens(x, y, dist, out);
+  }
+
+  // greedy alignment of the tokens and initials of a pair. The token
+  // distance matrix is extended with a row for each initial of x and a column
+  // for each initial of y: an initial is at distance initial_cost from a token
+  // starting with its letter, 0 from the same initial, and otherwise at
+  // initial_miss() from any token, so that it only matches by first letter.
+  // The first-letter sets of each name rule out whole rows and columns
+  // without looking at tokens. Merging adjacent tokens (merge_max) does not
+  // apply to pairs with initials
+  void align_initials(const name_tokens& x, const name_tokens& y, const double* dist, pair_summary& out) {
+    const int k_x = x.k(), k_y = y.k();
+    letters_x_.clear();
+    letters_y_.clear();
+    for (int c = 0; c < 26; ++c) {
+      if (x.initials >> c & 1) letters_x_.push_back(c);
+      if (y.initials >> c & 1) letters_y_.push_back(c);
+    }
+    const int n_x = k_x + static_cast<int>(letters_x_.size());
+    const int n_y = k_y + static_cast<int>(letters_y_.size());
+    const double miss_initial = initial_miss(1);
+    initials_dist_.resize(static_cast<std::size_t>(n_x) * n_y);
+    double* d = initials_dist_.data();
+
+    for (int i = 0; i < k_x; ++i) {
+      double* row = d + static_cast<std::size_t>(i) * n_y;
+      std::copy(dist + static_cast<std::size_t>(i) * k_y, dist + static_cast<std::size_t>(i + 1) * k_y, row);
+      const int first = name_tokens::letter_index(x.tokens[i][0]);
+      const double miss = initial_miss(x.tokens[i].size());
+      for (std::size_t b = 0; b < letters_y_.size(); ++b) {
+        row[k_y + b] = first == letters_y_[b] ? params_.initial_cost : miss;
+      }
+    }
+
+    for (std::size_t a = 0; a < letters_x_.size(); ++a) {
+      const int c = letters_x_[a];
+      double* row = d + static_cast<std::size_t>(k_x + a) * n_y;
+      const bool any = y.first_letters >> c & 1;
+      for (int j = 0; j < k_y; ++j) {
+        const bool hit = any && name_tokens::letter_index(y.tokens[j][0]) == c;
+        row[j] = hit ? params_.initial_cost : initial_miss(y.tokens[j].size());
+      }
+      for (std::size_t b = 0; b < letters_y_.size(); ++b) {
+        row[k_y + b] = letters_y_[b] == c ? 0.0 : miss_initial;
+      }
+    }
+
+    align_greedy(d, n_x, n_y, params_.dist_max, align_, out, trace_);
+  }
+
+  // distance between an initial and a token of n characters it does not
+  // abbreviate: n (as for OSA), but always above dist_max, and the largest
+  // distance (1) for Jaro-Winkler
+  double initial_miss(std::size_t n) const {
+    if (params_.method == DIST_JW) return 1.0;
+    const double above = std::floor(params_.dist_max) + 1.0;
+    return static_cast<double>(n) > above ? static_cast<double>(n) : above;
+  }
+
+  // re-align a summarized pair allowing adjacent tokens to be merged (see
+  // compound.h), if params_.merge_max > 1
+  void merge_tokens(const name_tokens& x, const name_tokens& y, const double* dist, pair_summary& out) {
+    if (params_.merge_max < 2) return;
+    const bool merged = compound_.apply(x, y, dist, params_.merge_max, params_.dist_max,
+      [this](const char32_t* run, const std::size_t* ends, int n_ends, token_view t, double* d) {
+        merged_dists(run, ends, n_ends, t, d);
+      }, out);
+    counters_.merges += merged;
+  }
+
+  // distances between run[0, ends[k]) and t, for compound_alignment. Runs
+  // whose length alone rules out a match get dist_max + 1 without computing
+  // the distance, and capped OSA distances for all ends come from a single DP
+  void merged_dists(const char32_t* run, const std::size_t* ends, int n_ends, token_view t, double* out) {
+    const double above = params_.dist_max + 1.0;
+    int last = -1;
+    for (int k = 0; k < n_ends; ++k) {
+      const std::size_t na = ends[k], nb = t.size();
+      const std::size_t diff = na > nb ? na - nb : nb - na;
+      double lower;
+      if (params_.method == DIST_JW) lower = jaro_winkler_lower_bound(na, nb, params_.jw_p);
+      else if (params_.method == DIST_WOSA) lower = diff * params_.costs->min_shift;
+      else lower = static_cast<double>(diff);
+      out[k] = lower > params_.dist_max ? above : -1.0;
+      if (out[k] < 0) last = k;
+    }
+    if (last < 0) return;
+    counters_.token_comparisons += 1;
+
+    if (params_.method == DIST_OSA) {
+      merged_work_.resize(last + 1);
+      osa_dist_prefixes(run, ends, last + 1, t.data(), t.size(), dist_bound(params_.dist_max),
+                        work_, merged_work_.data());
+      for (int k = 0; k <= last; ++k) if (out[k] < 0) out[k] = merged_work_[k];
+      return;
+    }
+    for (int k = 0; k <= last; ++k) {
+      if (out[k] >= 0) continue;
+      out[k] = params_.method == DIST_JW
+        ? jaro_winkler_dist(run, ends[k], t.data(), t.size(), params_.jw_p, work_)
+        : weighted_dist(run, ends[k], t.data(), t.size(), *params_.costs, params_.dist_max, wwork_, work_);
+    }
+  }
+
+  // whether the block methods batch token distances; batches use the OSA
+  // kernels of osa_simd.h, so other methods compare pairs one at a time
+  bool batched() const { return params_.simd && params_.method == DIST_OSA; }
+
+  // distance matrices for a block of pairs, concatenated in dist_ at offset_,
+  // filled through the batch and capped at bound + 1 if bound >= 0
+  void fill_dist_block(name_seq x, name_seq y, std::size_t n, std::size_t total, int bound) {
+    stage_timer t(profile_, STAGE_DISTANCE);
+    resize_dist(total);
+    for (std::size_t i = 0; i < n; ++i) {
+      if (offset_[i] == no_dist) continue;
+      batch_.add(x[i], y[i], dist_.data() + offset_[i]);
+    }
+    counters_.token_comparisons += batch_.size();
+    counters_.dist_cutoffs += batch_.run(bound);
+  }
+
+  void resize_dist(std::size_t n) { dist_.resize(n); }
+
+  // bytes held by the scratch buffers of the distance or alignment stage
+  std::size_t scratch_bytes(int s) const {
+    if (s == STAGE_DISTANCE) {
+      return (dist_.capacity() + wwork_.capacity()) * sizeof(double) +
+        (work_.capacity() + merged_work_.capacity()) * sizeof(int) +
+        offset_.capacity() * sizeof(std::size_t) + patterns_.capacity() * sizeof(jw_pattern) +
+        batch_.capacity_bytes();
+    }
+    return (aligned_.capacity() + initials_dist_.capacity()) * sizeof(double) +
+      (letters_x_.capacity() + letters_y_.capacity()) * sizeof(int) +
+      summaries_.capacity() * sizeof(pair_summary) + align_.capacity_bytes() + compound_.capacity_bytes();
+  }
+
+  // records into the profile the growth of the scratch buffers over a block
+  // of pairs, as one allocation per stage whose buffers grew. Once buffers
+  // have grown to fit the largest names, blocks allocate nothing. Watches
+  // nested in another (a block method calling another) do nothing
+  class scratch_watch {
+  public:
+    explicit scratch_watch(matcher& m) : m_(m), active_(m.profile_ && !m.watching_) {
+      if (!active_) return;
+      m_.watching_ = true;
+      before_[0] = m_.scratch_bytes(STAGE_DISTANCE);
+      before_[1] = m_.scratch_bytes(STAGE_ALIGN);
+    }
+
+    ~scratch_watch() {
+      if (!active_) return;
+      m_.watching_ = false;
+      m_.profile_->note_capacity(STAGE_DISTANCE, before_[0], m_.scratch_bytes(STAGE_DISTANCE), 1);
+      m_.profile_->note_capacity(STAGE_ALIGN, before_[1], m_.scratch_bytes(STAGE_ALIGN), 1);
+    }
+
+  private:
+    matcher& m_;
+    bool active_;
+    std::size_t before_[2] = {};
+  };
+
+  // integer distance bound for the capped OSA kernel
+  static int dist_bound(double x) {
+    if (!(x >= 0)) return 0;
+    if (x > 1 << 20) return 1 << 20;
+    return static_cast<int>(std::floor(x));
+  }
+
+  match_params params_;
+  match_counters counters_;
+  match_profile* profile_ = nullptr;
+  bool watching_ = false; // a scratch_watch is active
+  alignment_trace* trace_ = nullptr;
+  pair_summary summary_;
+  std::vector<double> dist_;
+  std::vector<int> work_;
+  std::vector<double> wwork_;
+  std::vector<double> aligned_;
+  std::vector<std::size_t> offset_;
+  greedy_alignment align_;
+  dist_batch batch_;
+  std::vector<jw_pattern> patterns_;
+  const name_tokens* patterns_of_ = nullptr; // name whose patterns are set
+  bool hold_patterns_ = false;
+  compound_alignment compound_;
+  std::vector<pair_summary> summaries_;
+  std::vector<int> merged_work_;
+  std::vector<int> letters_x_;
+  std::vector<int> letters_y_;
+  std::vector<double> initials_dist_;
+};
+
+} // namespace nmatch
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef NMATCH_EVAL_H
+#define NMATCH_EVAL_H
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+#include "align.h"
+
+namespace nmatch {
+
+// native equivalents of the R-level classification functions match_eval(),
+// match_min_n(), match_max_dist() and match_all_aligned(). Codes must match
+// eval_rule_native() in R/match_eval.R
+enum rule_kind {
+  RULE_NONE = 0,
+  RULE_MATCH_EVAL = 1,
+  RULE_MIN_N = 2,
+  RULE_MAX_DIST = 3,
+  RULE_ALL_ALIGNED = 4
+};
+
+struct eval_rule {
+  rule_kind kind;
+  double param;
+
+  // pairs without a valid summary (NA or no tokens) are never matches
+  bool operator()(const pair_summary& s) const {
+    if (!s.valid) return false;
+    switch (kind) {
+    case RULE_MATCH_EVAL: {
+      const int k_max = s.k_x > s.k_y ? s.k_x : s.k_y;
+      return s.n_match == k_max || s.n_match >= param;
+    }
+    case RULE_MIN_N:
+      return s.n_match >= param;
+    case RULE_MAX_DIST:
+      return s.dist_total <= param;
+    case RULE_ALL_ALIGNED:
+      return s.n_match == s.k_align;
+    default:
+      return false;
+    }
+  }
+
+  // rules other than RULE_MAX_DIST reduce to n_match >= threshold for a
+  // given k_x and k_y (for match_eval, n_match == max(k_x, k_y) is only
+  // reachable when k_x == k_y, in which case it is a threshold of k). This
+  // lets a pair be classified as soon as the threshold is provably reached or
+  // out of reach. Returns a value above k_align if no n_match can satisfy the
+  // rule, and 0 or less if any can
+  int n_match_threshold(int k_x, int k_y) const {
+    const int k_align = k_x < k_y ? k_x : k_y;
+    const double crit = std::ceil(param);
+    const int t = crit > k_align ? k_align + 1 : crit < 0 ? 0 : static_cast<int>(crit);
+    switch (kind) {
+    case RULE_MATCH_EVAL:
+      return k_x == k_y && k_x < t ? k_x : t;
+    case RULE_MIN_N:
+      return t;
+    case RULE_ALL_ALIGNED:
+      return k_align;
+    default:
+      return INT_MAX;
+    }
+  }
+
+  bool uses_threshold() const { return kind != RULE_MAX_DIST; }
+
+  // lowest n_match_threshold(k_x, k_y) over all k_y, and at least 1: the
+  // number of matching tokens a name with k_x tokens needs for any other
+  // name to match it. Thresholds no longer change once k_y exceeds k_x
+  int n_match_threshold_min(int k_x) const {
+    if (!uses_threshold() || kind == RULE_NONE) return 1;
+    int t = INT_MAX;
+    for (int k_y = 1; k_y <= k_x + 1 && t > 1; ++k_y) t = std::min(t, n_match_threshold(k_x, k_y));
+    return t < 1 ? 1 : t;
+  }
+};
+
+} // namespace nmatch
+
+#endif
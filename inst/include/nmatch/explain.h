@@ -0,0 +1,68 @@
+#ifndef NMATCH_EXPLAIN_H
+#define NMATCH_EXPLAIN_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "tokens.h"
+
+namespace nmatch {
+
+// distinct tokens of a set of names, each stored once and referred to by its
+// position in order of first occurrence
+class token_dictionary {
+public:
+  int intern(token_view t) {
+    const std::uint64_t h = name_tokens::token_hash(t);
+    auto range = ids_.equal_range(h);
+    for (auto it = range.first; it != range.second; ++it) {
+      if (tokens_[it->second] == t) return it->second;
+    }
+    const int id = static_cast<int>(tokens_.size());
+    ids_.emplace(h, id);
+    tokens_.push_back(t.str());
+    return id;
+  }
+
+  // append to `out` the ids of the tokens of `name`, then of its initials (as
+  // single-letter tokens) in letter order, i.e. in the order of the rows or
+  // columns of its distance matrix
+  void intern_name(const name_tokens& name, std::vector<int>& out) {
+    for (token_view t : name.tokens) out.push_back(intern(t));
+    for (int c = 0; c < 26; ++c) {
+      const char32_t letter = static_cast<char32_t>('A' + c);
+      if (name.initials >> c & 1) out.push_back(intern(token_view(&letter, 1)));
+    }
+  }
+
+  const std::vector<token_t>& tokens() const { return tokens_; }
+
+private:
+  std::unordered_multimap<std::uint64_t, int> ids_; // by token hash
+  std::vector<token_t> tokens_;
+};
+
+// token ids of a set of names, in compressed sparse row layout: the ids of
+// name i are ids[begin[i]] to ids[begin[i + 1] - 1]
+struct name_token_ids {
+  std::vector<std::size_t> begin;
+  std::vector<int> ids;
+
+  name_token_ids(const std::vector<name_tokens>& names, token_dictionary& dict) {
+    begin.reserve(names.size() + 1);
+    begin.push_back(0);
+    for (const name_tokens& name : names) {
+      dict.intern_name(name, ids);
+      begin.push_back(ids.size());
+    }
+  }
+
+  int operator()(std::size_t name, int token) const { return ids[begin[name] + token]; }
+};
+
+} // namespace nmatch
+
+#endif
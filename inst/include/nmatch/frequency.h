@@ -0,0 +1,185 @@
+#ifndef NMATCH_FREQUENCY_H
+#define NMATCH_FREQUENCY_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "align.h"
+#include "tokens.h"
+
+namespace nmatch {
+
+// approximate counts of items given by 64-bit hashes, in `depth` rows of
+// 2^width_log2 counters. An item is counted in one counter per row, chosen
+// by double hashing, and its estimate is the smallest of its counters, which
+// is never below its true count. Counters are updated conservatively (only
+// those at the current estimate are incremented), which keeps estimates of
+// rare items close to their true counts
+class count_min_sketch {
+public:
+  count_min_sketch(int width_log2, int depth)
+      : mask_((std::size_t(1) << width_log2) - 1), depth_(depth),
+        counts_(static_cast<std::size_t>(depth) << width_log2, 0) {}
+
+  void add(std::uint64_t h) {
+    const std::uint32_t est = estimate(h);
+    for (int r = 0; r < depth_; ++r) {
+      std::uint32_t& c = counts_[cell(h, r)];
+      if (c == est) ++c;
+    }
+  }
+
+  std::uint32_t estimate(std::uint64_t h) const {
+    std::uint32_t out = UINT32_MAX;
+    for (int r = 0; r < depth_; ++r) out = std::min(out, counts_[cell(h, r)]);
+    return out;
+  }
+
+  std::size_t capacity_bytes() const { return counts_.capacity() * sizeof(std::uint32_t); }
+
+private:
+  std::size_t cell(std::uint64_t h, int r) const {
+    const std::uint64_t h1 = h & 0xffffffffULL, h2 = (h >> 32) | 1;
+    return static_cast<std::size_t>(r) * (mask_ + 1) + static_cast<std::size_t>((h1 + r * h2) & mask_);
+  }
+
+  std::size_t mask_;
+  int depth_;
+  std::vector<std::uint32_t> counts_;
+};
+
+// number of names in which each token occurs (its document frequency), over
+// the names added with add_name(). Counts are kept exactly in a hash table of
+// the tokens themselves (views into the tokens of the names, which must
+// outlive the counts), or for very large inputs approximately in a
+// count_min_sketch of fixed size
+class token_frequencies {
+public:
+  explicit token_frequencies(bool sketch)
+      : sketch_(sketch), counts_(sketch ? 20 : 0, sketch ? 4 : 0) {}
+
+  // count the tokens of a name, each once (tokens are deduplicated by
+  // name_tokens::add())
+  void add_name(const name_tokens& name) {
+    if (name.tokens.empty()) return;
+    ++n_names_;
+    for (token_view t : name.tokens) {
+      const std::uint64_t h = name_tokens::token_hash(t);
+      if (sketch_) {
+        counts_.add(h);
+      } else {
+        ++exact_count(h, t);
+      }
+    }
+  }
+
+  std::uint32_t count(token_view t) const {
+    const std::uint64_t h = name_tokens::token_hash(t);
+    if (sketch_) return counts_.estimate(h);
+    auto range = exact_.equal_range(h);
+    for (auto it = range.first; it != range.second; ++it) {
+      if (it->second.token == t) return it->second.count;
+    }
+    return 0;
+  }
+
+  // smoothed inverse document frequency, ln((1 + N) / (1 + df)) + 1 for N
+  // names with tokens: 1 for a token found in every name, more the rarer it is
+  double idf(token_view t) const {
+    return std::log((1.0 + n_names_) / (1.0 + count(t))) + 1.0;
+  }
+
+  std::size_t n_names() const { return n_names_; }
+
+  bool sketched() const { return sketch_; }
+
+  std::size_t capacity_bytes() const {
+    return counts_.capacity_bytes() +
+      exact_.size() * (sizeof(std::uint64_t) + sizeof(exact_entry) + 2 * sizeof(void*)) +
+      exact_.bucket_count() * sizeof(void*);
+  }
+
+private:
+  struct exact_entry {
+    token_view token;
+    std::uint32_t count;
+  };
+
+  // count of token `t` of hash `h`, found by hash then compared (as in
+  // token_dictionary in explain.h), added at 0 if new
+  std::uint32_t& exact_count(std::uint64_t h, token_view t) {
+    auto range = exact_.equal_range(h);
+    for (auto it = range.first; it != range.second; ++it) {
+      if (it->second.token == t) return it->second.count;
+    }
+    return exact_.emplace(h, exact_entry{t, 0})->second.count;
+  }
+
+  bool sketch_;
+  std::size_t n_names_ = 0;
+  std::unordered_multimap<std::uint64_t, exact_entry> exact_; // by token hash
+  count_min_sketch counts_;
+};
+
+// IDF weights of the tokens of a set of names, in compressed sparse row
+// layout as name_token_ids (see explain.h), and the total weight of each
+// name. Initials weigh 1, as a token found in every name would
+struct name_weights {
+  std::vector<std::size_t> begin;
+  std::vector<double> weights;
+  std::vector<double> total;
+
+  name_weights(const std::vector<name_tokens>& names, const token_frequencies& freq) {
+    begin.reserve(names.size() + 1);
+    total.reserve(names.size());
+    begin.push_back(0);
+    for (const name_tokens& name : names) {
+      double sum = name.n_initials();
+      for (token_view t : name.tokens) {
+        weights.push_back(freq.idf(t));
+        sum += weights.back();
+      }
+      begin.push_back(weights.size());
+      total.push_back(sum);
+    }
+  }
+
+  // weight of token `token` of name `name`, where tokens past the name's own
+  // are initials (as in the rows and columns of its distance matrix)
+  double operator()(std::size_t name, int token) const {
+    const std::size_t k = begin[name] + token;
+    return k < begin[name + 1] ? weights[k] : 1.0;
+  }
+};
+
+// IDF-weighted counterparts of n_match: the summed weight of the matching
+// aligned token pairs (distance <= dist_max), each weighing the mean weight
+// of its two tokens, and that sum as a share of the total weight of the
+// heavier name (1 for names whose every token is matched)
+struct weighted_summary {
+  double n_match;
+  double score;
+};
+
+// weighted summary of pair (x name ix, y name iy) from the `n` token pairs
+// of `trace` from entry `entry`
+inline weighted_summary weigh_alignment(const name_weights& wx, std::size_t ix,
+                                        const name_weights& wy, std::size_t iy,
+                                        const alignment_trace& trace, std::size_t entry, int n,
+                                        double dist_max) {
+  weighted_summary out{0.0, 0.0};
+  for (std::size_t e = entry; e < entry + n; ++e) {
+    if (trace.dist[e] <= dist_max) out.n_match += 0.5 * (wx(ix, trace.x[e]) + wy(iy, trace.y[e]));
+  }
+  const double total = std::max(wx.total[ix], wy.total[iy]);
+  out.score = total > 0 ? out.n_match / total : 0.0;
+  return out;
+}
+
+} // namespace nmatch
+
+#endif
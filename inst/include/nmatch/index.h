@@ -0,0 +1,433 @@
+#ifndef NMATCH_INDEX_H
+#define NMATCH_INDEX_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "engine.h"
+#include "tokens.h"
+
+namespace nmatch {
+
+typedef std::uint64_t record_id;
+
+// set of characters of a token as a 32-bit mask: bits 0-25 for the letters
+// A-Z (either case), and bits 26-31 shared by all other characters. Each OSA
+// edit adds or removes at most one character of a token's character set, so
+// the number of characters in one set but not the other is a lower bound on
+// the OSA distance (shared bits only make it looser)
+inline std::uint32_t char_mask(token_view t) {
+  std::uint32_t m = 0;
+  for (char32_t c : t) {
+    const int l = name_tokens::letter_index(c);
+    m |= std::uint32_t(1) << (l >= 0 ? l : 26 + static_cast<int>(c % 6));
+  }
+  return m;
+}
+
+// whether the character set bound of the masks of two tokens is at most d.
+// Clearing the lowest set bit d times empties a mask of at most d bits,
+// which is cheaper than counting bits without a popcount instruction
+inline bool char_mask_within(std::uint32_t a, std::uint32_t b, int d) {
+  std::uint32_t ab = a & ~b, ba = b & ~a;
+  for (int i = 0; i < d && (ab | ba); ++i) {
+    ab &= ab - 1;
+    ba &= ba - 1;
+  }
+  return (ab | ba) == 0;
+}
+
+// an immutable batch of indexed names: the tokenized names with their record
+// ids, a dictionary of their distinct tokens sorted by length, and for each
+// dictionary token the (ascending) positions of the names containing it. The
+// segment copies the tokens of its names into an arena of its own, so the
+// names passed in may view storage that is freed once it is built
+class index_segment {
+public:
+  index_segment(std::vector<name_tokens>&& names, std::vector<record_id>&& ids)
+    : names_(std::move(names)), ids_(std::move(ids)) {
+    own_tokens();
+    build();
+  }
+
+  std::size_t size() const { return names_.size(); }
+  std::size_t n_tokens() const { return dict_.size(); }
+  const name_tokens& name(std::size_t i) const { return names_[i]; }
+  record_id id(std::size_t i) const { return ids_[i]; }
+
+  // position `i` of the record with id `id`, if in the segment
+  bool find(record_id id, std::size_t& i) const {
+    const std::vector<record_id>::const_iterator it = std::lower_bound(ids_.begin(), ids_.end(), id);
+    if (it == ids_.end() || *it != id) return false;
+    i = static_cast<std::size_t>(it - ids_.begin());
+    return true;
+  }
+
+  // positions of names with a token within the match threshold of `q`
+  // according to m.token_match(), appended to `out`. With `osa_bound`, the
+  // OSA lower bounds from token lengths and character sets skip most of the
+  // dictionary without computing any distance
+  void search(token_view q, matcher& m, int osa_bound, std::vector<std::uint32_t>& out) const {
+    std::size_t lo = 0, hi = dict_.size();
+    std::uint32_t q_mask = 0;
+    if (osa_bound >= 0) {
+      const std::size_t len_min = q.size() > static_cast<std::size_t>(osa_bound) ? q.size() - osa_bound : 0;
+      const std::size_t len_max = q.size() + osa_bound;
+      lo = len_min < len_begin_.size() ? len_begin_[len_min] : dict_.size();
+      hi = len_max + 1 < len_begin_.size() ? len_begin_[len_max + 1] : dict_.size();
+      q_mask = char_mask(q);
+    }
+    if (osa_bound < 0) {
+      for (std::size_t t = lo; t < hi; ++t) add_if_match(q, t, m, out);
+      return;
+    }
+    // the character set filter rejects nearly all tokens, so it runs on its
+    // own over blocks of the dictionary, without branches, and distances are
+    // only computed for the tokens it lets through
+    std::uint32_t pass[256];
+    for (std::size_t b = lo; b < hi; b += 256) {
+      const std::size_t e = hi - b < 256 ? hi : b + 256;
+      std::size_t n = 0;
+      for (std::size_t t = b; t < e; ++t) {
+        pass[n] = static_cast<std::uint32_t>(t);
+        n += char_mask_within(q_mask, masks_[t], osa_bound);
+      }
+      for (std::size_t k = 0; k < n; ++k) add_if_match(q, pass[k], m, out);
+    }
+  }
+
+private:
+  void add_if_match(token_view q, std::size_t t, matcher& m, std::vector<std::uint32_t>& out) const {
+    if (!m.token_match(q, dict_[t])) return;
+    out.insert(out.end(), postings_.begin() + post_begin_[t], postings_.begin() + post_begin_[t + 1]);
+  }
+
+  void own_tokens() {
+    std::size_t n = 0;
+    for (const name_tokens& name : names_) {
+      for (token_view t : name.tokens) n += t.size();
+    }
+    arena_.reserve(n);
+    for (name_tokens& name : names_) {
+      for (token_view& t : name.tokens) t = arena_.store(t.data(), t.size());
+    }
+  }
+
+  void build() {
+    // distinct tokens, ordered by length then content
+    std::vector<std::pair<token_view, std::uint32_t>> occ;
+    for (std::size_t i = 0; i < names_.size(); ++i) {
+      for (token_view t : names_[i].tokens) occ.emplace_back(t, static_cast<std::uint32_t>(i));
+    }
+    std::sort(occ.begin(), occ.end(), [](const std::pair<token_view, std::uint32_t>& a,
+                                         const std::pair<token_view, std::uint32_t>& b) {
+      if (a.first.size() != b.first.size()) return a.first.size() < b.first.size();
+      const int c = a.first.compare(b.first);
+      return c != 0 ? c < 0 : a.second < b.second;
+    });
+
+    postings_.reserve(occ.size());
+    for (std::size_t k = 0; k < occ.size(); ++k) {
+      if (k == 0 || occ[k].first != occ[k - 1].first) {
+        post_begin_.push_back(postings_.size());
+        dict_.push_back(occ[k].first);
+        masks_.push_back(char_mask(dict_.back()));
+      }
+      postings_.push_back(occ[k].second);
+    }
+    post_begin_.push_back(postings_.size());
+
+    // len_begin_[l]: first dictionary token of length >= l
+    const std::size_t max_len = dict_.empty() ? 0 : dict_.back().size();
+    len_begin_.resize(max_len + 2);
+    std::size_t t = 0;
+    for (std::size_t l = 0; l < len_begin_.size(); ++l) {
+      while (t < dict_.size() && dict_[t].size() < l) ++t;
+      len_begin_[l] = t;
+    }
+  }
+
+  token_arena arena_;
+  std::vector<name_tokens> names_;
+  std::vector<record_id> ids_;
+  std::vector<token_view> dict_;
+  std::vector<std::uint32_t> masks_;
+  std::vector<std::size_t> post_begin_;
+  std::vector<std::uint32_t> postings_;
+  std::vector<std::size_t> len_begin_;
+};
+
+// a candidate record for a query name. n_shared counts the tokens of the
+// query matching a token of the record (a query token matching several
+// counts several times), an upper bound on the pair's n_match
+struct index_hit {
+  record_id id;
+  const name_tokens* name;
+  int n_shared;
+};
+
+// scratch space for index_snapshot::search(), reused across queries
+struct index_search_work {
+  std::vector<std::uint32_t> postings;
+  std::vector<std::uint32_t> candidates;
+  std::vector<std::uint8_t> counts;
+};
+
+// an immutable state of a name_index: its segments, each with the tombstones
+// of its deleted records. Snapshots share their segments and unchanged
+// tombstones with one another, so publishing one after an update copies only
+// what the update changed. Names found by search() remain valid while the
+// snapshot is held
+class index_snapshot {
+public:
+  std::size_t size() const { return next_id_; }
+  std::size_t n_deleted() const { return n_deleted_; }
+  std::size_t n_segments() const { return parts_.size(); }
+
+  std::size_t n_tokens() const {
+    std::size_t n = 0;
+    for (const part& p : parts_) n += p.segment->n_tokens();
+    return n;
+  }
+
+  bool deleted(record_id id) const {
+    if (id >= next_id_) return false;
+    std::size_t p, i;
+    // records absent from every segment were removed by compaction
+    return !find(id, p, i) || is_tombstone(parts_[p], i);
+  }
+
+  // live records with at least `min_shared` (>= 1) tokens matching a token
+  // of `q` under m.token_match(), in ascending order of id. Names need as
+  // many matching tokens as their n_match, so a rule requiring n_match >=
+  // min_shared misses no matching record (see eval_rule::n_match_threshold());
+  // with the built-in classification rules and n_match_crit >= 1, min_shared
+  // = 1 is always safe. `osa_bound` enables the OSA pre-filters of
+  // index_segment::search() (-1 for other methods)
+  void search(const name_tokens& q, matcher& m, int osa_bound, int min_shared,
+              std::vector<index_hit>& out, index_search_work& work) const {
+    out.clear();
+    for (const part& p : parts_) {
+      work.postings.clear();
+      for (token_view t : q.tokens) p.segment->search(t, m, osa_bound, work.postings);
+
+      // count the postings of each record, then keep the records reaching
+      // min_shared; counts are reset as they are read
+      if (work.counts.size() < p.segment->size()) work.counts.resize(p.segment->size(), 0);
+      std::uint8_t* counts = work.counts.data();
+      work.candidates.clear();
+      for (std::uint32_t i : work.postings) {
+        if (counts[i] == 0) work.candidates.push_back(i);
+        if (counts[i] < 255) ++counts[i];
+      }
+      std::size_t n = 0;
+      for (std::uint32_t i : work.candidates) {
+        if (counts[i] >= min_shared && !is_tombstone(p, i)) {
+          work.candidates[n++] = i;
+        } else {
+          counts[i] = 0;
+        }
+      }
+      work.candidates.resize(n);
+      std::sort(work.candidates.begin(), work.candidates.end());
+      for (std::uint32_t i : work.candidates) {
+        out.push_back(index_hit{p.segment->id(i), &p.segment->name(i), counts[i]});
+        counts[i] = 0;
+      }
+    }
+  }
+
+private:
+  friend class name_index;
+
+  struct part {
+    std::shared_ptr<const index_segment> segment;
+    // tombstones by position in the segment, or null if none
+    std::shared_ptr<const std::vector<char>> deleted;
+  };
+
+  static bool is_tombstone(const part& p, std::size_t i) {
+    return p.deleted && (*p.deleted)[i];
+  }
+
+  // segments hold ascending ids, and each segment's ids follow those of the
+  // segments before it, so records are found by binary search
+  bool find(record_id id, std::size_t& p, std::size_t& i) const {
+    std::size_t lo = 0, hi = parts_.size();
+    while (lo < hi) {
+      const std::size_t mid = lo + (hi - lo) / 2;
+      if (parts_[mid].segment->id(parts_[mid].segment->size() - 1) < id) lo = mid + 1;
+      else hi = mid;
+    }
+    if (lo == parts_.size()) return false;
+    p = lo;
+    return parts_[p].segment->find(id, i);
+  }
+
+  std::vector<part> parts_;
+  record_id next_id_ = 0;
+  std::size_t n_deleted_ = 0;
+};
+
+// updatable index of tokenized names, for linking new names against a
+// registry without comparing them to every record. Names are appended in
+// batches, each stored as an immutable segment, so an append only indexes
+// the new names. Deleted records are tombstoned and skipped by searches until
+// compact() rebuilds the live records into a single segment, reclaiming
+// their space and sparing searches a dictionary scan per segment. Record ids
+// are assigned in order of appending from 0, and are never reused.
+//
+// Readers work on snapshots, which are never modified. Each update (one batch
+// of appends or deletions, or a compaction) builds a new snapshot and
+// publishes it by swapping an atomic pointer to the root, so concurrent
+// readers see either all of an update or none of it. Updates are serialized
+// by a mutex that readers never take.
+//
+// snapshot() takes no lock: it registers in the reader count of the current
+// epoch, loads the root pointer and copies the shared_ptr it holds (an atomic
+// reference count increment), then unregisters. A writer frees the root it
+// replaced only after flipping the epoch and waiting for the readers of the
+// old one, which are at most copying a shared_ptr, so readers never wait on
+// writers or on each other, and writers never wait on readers arriving after
+// them
+class name_index {
+public:
+  name_index() : root_(new root_node{std::make_shared<const index_snapshot>()}) {}
+
+  ~name_index() { delete root_.load(); }
+
+  name_index(const name_index&) = delete;
+  name_index& operator=(const name_index&) = delete;
+
+  std::shared_ptr<const index_snapshot> snapshot() const {
+    for (;;) {
+      const std::uint64_t epoch = epoch_.load();
+      std::atomic<std::uint64_t>& readers = readers_[epoch & 1];
+      readers.fetch_add(1);
+      // a writer that flipped the epoch since may not be waiting for us
+      if (epoch_.load() != epoch) {
+        readers.fetch_sub(1);
+        continue;
+      }
+      std::shared_ptr<const index_snapshot> out = root_.load()->snapshot;
+      readers.fetch_sub(1);
+      return out;
+    }
+  }
+
+  // index a batch of names, returning the id of the first (the others
+  // following consecutively)
+  record_id append(std::vector<name_tokens>&& names) {
+    std::lock_guard<std::mutex> lock(write_);
+    const std::shared_ptr<const index_snapshot> cur = snapshot();
+    const record_id first = cur->next_id_;
+    if (names.empty()) return first;
+
+    const std::size_t n = names.size();
+    std::vector<record_id> ids(n);
+    for (std::size_t i = 0; i < n; ++i) ids[i] = first + i;
+    std::shared_ptr<index_snapshot> next = std::make_shared<index_snapshot>(*cur);
+    next->parts_.push_back(index_snapshot::part{
+      std::make_shared<const index_segment>(std::move(names), std::move(ids)), nullptr
+    });
+    next->next_id_ += n;
+    publish(std::move(next));
+    return first;
+  }
+
+  // tombstone a batch of records, returning the number not already deleted.
+  // Throws std::out_of_range, leaving the index unchanged, if any id was
+  // never assigned
+  std::size_t remove(const std::vector<record_id>& ids) {
+    std::lock_guard<std::mutex> lock(write_);
+    const std::shared_ptr<const index_snapshot> cur = snapshot();
+    for (record_id id : ids) {
+      if (id >= cur->next_id_) throw std::out_of_range("record id not in index");
+    }
+
+    std::shared_ptr<index_snapshot> next = std::make_shared<index_snapshot>(*cur);
+    // tombstone vectors copied for this update, by part
+    std::vector<std::shared_ptr<std::vector<char>>> copies(next->parts_.size());
+    std::size_t n = 0;
+    for (record_id id : ids) {
+      std::size_t p, i;
+      if (!next->find(id, p, i)) continue;
+      index_snapshot::part& part = next->parts_[p];
+      if (index_snapshot::is_tombstone(part, i)) continue;
+      if (!copies[p]) {
+        copies[p] = part.deleted
+          ? std::make_shared<std::vector<char>>(*part.deleted)
+          : std::make_shared<std::vector<char>>(part.segment->size(), 0);
+        part.deleted = copies[p];
+      }
+      (*copies[p])[i] = 1;
+      ++n;
+    }
+    if (n == 0) return 0;
+    next->n_deleted_ += n;
+    publish(std::move(next));
+    return n;
+  }
+
+  // rebuild the live records into a single segment
+  void compact() {
+    std::lock_guard<std::mutex> lock(write_);
+    const std::shared_ptr<const index_snapshot> cur = snapshot();
+    std::vector<name_tokens> names;
+    std::vector<record_id> ids;
+    names.reserve(cur->next_id_ - cur->n_deleted_);
+    ids.reserve(cur->next_id_ - cur->n_deleted_);
+    for (const index_snapshot::part& p : cur->parts_) {
+      for (std::size_t i = 0; i < p.segment->size(); ++i) {
+        if (index_snapshot::is_tombstone(p, i)) continue;
+        names.push_back(p.segment->name(i));
+        ids.push_back(p.segment->id(i));
+      }
+    }
+
+    std::shared_ptr<index_snapshot> next = std::make_shared<index_snapshot>(*cur);
+    next->parts_.clear();
+    if (!names.empty()) {
+      next->parts_.push_back(index_snapshot::part{
+        std::make_shared<const index_segment>(std::move(names), std::move(ids)), nullptr
+      });
+    }
+    publish(std::move(next));
+  }
+
+private:
+  struct root_node {
+    std::shared_ptr<const index_snapshot> snapshot;
+  };
+
+  static_assert(std::atomic<root_node*>::is_always_lock_free &&
+                  std::atomic<std::uint64_t>::is_always_lock_free,
+                "name_index readers require lock-free atomics");
+
+  // swap in the new root, then free the old one once no reader can still be
+  // copying it: readers registered in the current epoch may have loaded it,
+  // those of the next epoch load the new root
+  void publish(std::shared_ptr<const index_snapshot> s) {
+    root_node* old = root_.exchange(new root_node{std::move(s)});
+    const std::uint64_t epoch = epoch_.fetch_add(1);
+    while (readers_[epoch & 1].load() != 0) std::this_thread::yield();
+    delete old;
+  }
+
+  std::mutex write_;
+  std::atomic<root_node*> root_;
+  mutable std::atomic<std::uint64_t> epoch_{0};
+  mutable std::atomic<std::uint64_t> readers_[2] = {{0}, {0}};
+};
+
+} // namespace nmatch
+
+#endif
@@ -0,0 +1,184 @@
+#ifndef NMATCH_JARO_H
+#define NMATCH_JARO_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "tokens.h"
+
+namespace nmatch {
+
+// Jaro-Winkler distance, equivalent to stringdist(method = "jw", p = p):
+// 1 - sim, with Jaro similarity
+//   sim = (m / na + m / nb + (m - t) / m) / 3
+// for m characters matching within a window of max(na, nb) / 2 - 1
+// positions (each character of a taking the first unmatched equal character
+// of b in the window) and t half the number of matched characters that are
+// out of order, rounded down. With p > 0, the distance is reduced by a
+// factor of p * l for the length l <= 4 of the common prefix
+
+// largest token handled by the bit-parallel kernel
+const int jw_bitpar_max_len = 64;
+
+inline double jaro_winkler_finish(int m, int t, std::size_t na, std::size_t nb, int prefix, double p) {
+  if (m == 0) return 1.0;
+  double d = 1.0 - (static_cast<double>(m) / na + static_cast<double>(m) / nb +
+                    static_cast<double>(m - t / 2) / m) / 3.0;
+  if (p > 0 && d > 0) d -= p * prefix * d;
+  return d;
+}
+
+template <typename C>
+int common_prefix(const C* a, std::size_t na, const C* b, std::size_t nb) {
+  const std::size_t n = std::min(std::min(na, nb), std::size_t(4));
+  std::size_t i = 0;
+  while (i < n && a[i] == b[i]) ++i;
+  return static_cast<int>(i);
+}
+
+// mask of the lowest n bits
+inline std::uint64_t low_bits(std::size_t n) {
+  return n >= 64 ? ~std::uint64_t(0) : (std::uint64_t(1) << n) - 1;
+}
+
+inline int match_window(std::size_t na, std::size_t nb) {
+  const int w = static_cast<int>(std::max(na, nb) / 2) - 1;
+  return w > 0 ? w : 0;
+}
+
+// reference implementation for tokens of any length
+template <typename C>
+double jaro_winkler_dist(const C* a, std::size_t na, const C* b, std::size_t nb, double p,
+                         std::vector<int>& work) {
+  if (na == 0) return nb == 0 ? 0.0 : 1.0;
+  if (nb == 0) return 1.0;
+
+  const int w = match_window(na, nb);
+  work.assign(na + nb, 0);
+  int* match_a = work.data();
+  int* match_b = match_a + na;
+
+  int m = 0;
+  for (std::size_t i = 0; i < na; ++i) {
+    const std::size_t lo = i > static_cast<std::size_t>(w) ? i - w : 0;
+    const std::size_t hi = std::min(nb - 1, i + w);
+    for (std::size_t j = lo; j <= hi; ++j) {
+      if (!match_b[j] && a[i] == b[j]) {
+        match_a[i] = match_b[j] = 1;
+        ++m;
+        break;
+      }
+    }
+  }
+
+  int t = 0;
+  for (std::size_t i = 0, j = 0; i < na; ++i) {
+    if (!match_a[i]) continue;
+    while (!match_b[j]) ++j;
+    t += a[i] != b[j];
+    ++j;
+  }
+
+  return jaro_winkler_finish(m, t, na, nb, common_prefix(a, na, b, nb), p);
+}
+
+// positions of each character of a token of up to jw_bitpar_max_len
+// characters, as bitmasks. Characters below U+0100 are looked up in a
+// table; set() and clear() only touch the entries of the token, so a
+// pattern can be reused across tokens cheaply
+class jw_pattern {
+public:
+  jw_pattern() { std::fill(latin1_, latin1_ + 256, std::uint64_t(0)); }
+
+  template <typename C>
+  void set(const C* s, std::size_t n) {
+    for (std::size_t j = 0; j < n; ++j) {
+      const std::uint64_t bit = std::uint64_t(1) << j;
+      if (s[j] < 256) {
+        latin1_[s[j]] |= bit;
+        continue;
+      }
+      auto it = std::find_if(other_.begin(), other_.end(),
+                             [&](const std::pair<char32_t, std::uint64_t>& e) { return e.first == s[j]; });
+      if (it == other_.end()) other_.emplace_back(s[j], bit);
+      else it->second |= bit;
+    }
+  }
+
+  template <typename C>
+  void clear(const C* s, std::size_t n) {
+    for (std::size_t j = 0; j < n; ++j) if (s[j] < 256) latin1_[s[j]] = 0;
+    other_.clear();
+  }
+
+  // the bytes of ASCII names (see name_tokens::narrow) need no range check
+  std::uint64_t operator[](unsigned char c) const { return latin1_[c]; }
+
+  std::uint64_t operator[](char32_t c) const {
+    if (c < 256) return latin1_[c];
+    for (const auto& e : other_) if (e.first == c) return e.second;
+    return 0;
+  }
+
+private:
+  std::uint64_t latin1_[256];
+  std::vector<std::pair<char32_t, std::uint64_t>> other_;
+};
+
+// bit-parallel equivalent of jaro_winkler_dist(), for na, nb <=
+// jw_bitpar_max_len, given the pattern of b. Each character of a finds its
+// match in b with a single mask operation (the lowest unmatched equal
+// position within the window), and transpositions are counted by walking
+// the matched positions of a and b in step
+template <typename C>
+double jaro_winkler_dist(const C* a, std::size_t na, const jw_pattern& pb, const C* b,
+                         std::size_t nb, double p) {
+  if (na == 0) return nb == 0 ? 0.0 : 1.0;
+  if (nb == 0) return 1.0;
+
+  const int w = match_window(na, nb);
+  const std::uint64_t all_b = low_bits(nb);
+  std::uint64_t matched_a = 0, matched_b = 0;
+
+  for (std::size_t i = 0; i < na; ++i) {
+    // window [i - w, i + w]
+    std::uint64_t window = low_bits(i + w + 1) & all_b;
+    if (i > static_cast<std::size_t>(w)) window &= ~low_bits(i - w);
+    const std::uint64_t cand = pb[a[i]] & ~matched_b & window;
+    if (cand) {
+      matched_b |= cand & (~cand + 1);
+      matched_a |= std::uint64_t(1) << i;
+    }
+  }
+
+  const int m = __builtin_popcountll(matched_a);
+  int t = 0;
+  while (matched_a) {
+    const int i = __builtin_ctzll(matched_a);
+    const int j = __builtin_ctzll(matched_b);
+    t += a[i] != b[j];
+    matched_a &= matched_a - 1;
+    matched_b &= matched_b - 1;
+  }
+
+  return jaro_winkler_finish(m, t, na, nb, common_prefix(a, na, b, nb), p);
+}
+
+// smallest Jaro-Winkler distance possible between tokens of lengths na and
+// nb (all of the shorter token matching in order, with a full prefix), used
+// to skip tokens that can't be within a threshold
+inline double jaro_winkler_lower_bound(std::size_t na, std::size_t nb, double p) {
+  if (na == 0 || nb == 0) return na == nb ? 0.0 : 1.0;
+  const double m = static_cast<double>(std::min(na, nb));
+  double d = 1.0 - (m / na + m / nb + 1.0) / 3.0;
+  const int prefix = static_cast<int>(std::min(std::min(na, nb), std::size_t(4)));
+  if (p > 0 && d > 0) d -= p * prefix * d;
+  return d;
+}
+
+} // namespace nmatch
+
+#endif
@@ -0,0 +1,175 @@
+#ifndef NMATCH_OSA_H
+#define NMATCH_OSA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+namespace nmatch {
+
+// optimal string alignment distance (restricted Damerau-Levenshtein), with
+// unit costs for deletion, insertion, substitution and transposition of
+// adjacent characters; equivalent to stringdist(method = "osa")
+template <typename C>
+int osa_dist(const C* a, std::size_t na, const C* b, std::size_t nb,
+             std::vector<int>& work) {
+  if (na == 0) return static_cast<int>(nb);
+  if (nb == 0) return static_cast<int>(na);
+
+  // three rolling rows of the (na + 1) x (nb + 1) DP matrix
+  const std::size_t w = nb + 1;
+  work.resize(3 * w);
+  int* prev2 = work.data();
+  int* prev = prev2 + w;
+  int* cur = prev + w;
+
+  for (std::size_t j = 0; j <= nb; ++j) prev[j] = static_cast<int>(j);
+
+  for (std::size_t i = 1; i <= na; ++i) {
+    cur[0] = static_cast<int>(i);
+    const C ai = a[i - 1];
+    for (std::size_t j = 1; j <= nb; ++j) {
+      const int cost = ai == b[j - 1] ? 0 : 1;
+      int d = std::min(std::min(prev[j] + 1, cur[j - 1] + 1), prev[j - 1] + cost);
+      if (i > 1 && j > 1 && ai == b[j - 2] && a[i - 2] == b[j - 1]) {
+        d = std::min(d, prev2[j - 2] + 1);
+      }
+      cur[j] = d;
+    }
+    int* tmp = prev2;
+    prev2 = prev;
+    prev = cur;
+    cur = tmp;
+  }
+
+  return prev[nb];
+}
+
+// OSA distance capped at bound + 1, i.e. min(osa_dist(a, b), bound + 1). Only
+// the diagonal band |i - j| <= bound of the DP matrix is computed, and the
+// computation stops as soon as every remaining cell must exceed the bound.
+// Used when classifying pairs, where distances beyond the match threshold
+// never change the outcome
+template <typename C>
+int osa_dist_bounded(const C* a, std::size_t na, const C* b, std::size_t nb,
+                     int bound, std::vector<int>& work) {
+  const int cap = bound + 1;
+  const int diff = na > nb ? static_cast<int>(na - nb) : static_cast<int>(nb - na);
+  if (diff > bound) return cap;
+  if (na == 0 || nb == 0) return diff;
+
+  const std::size_t w = nb + 1;
+  work.assign(3 * w, cap);
+  int* prev2 = work.data();
+  int* prev = prev2 + w;
+  int* cur = prev + w;
+
+  for (std::size_t j = 0; j <= nb && static_cast<int>(j) <= bound; ++j) {
+    prev[j] = static_cast<int>(j);
+  }
+  int prev_min = 0;
+
+  const std::size_t ub = static_cast<std::size_t>(bound);
+  for (std::size_t i = 1; i <= na; ++i) {
+    const std::size_t lo = i > ub ? i - ub : 1;
+    const std::size_t hi = i + ub < nb ? i + ub : nb;
+
+    // cells bordering the band must read as capped, since the rolling rows
+    // may hold stale values from earlier iterations
+    cur[0] = i < static_cast<std::size_t>(cap) ? static_cast<int>(i) : cap;
+    if (lo > 1) cur[lo - 1] = cap;
+    if (hi < nb) cur[hi + 1] = cap;
+
+    int row_min = lo == 1 ? cur[0] : cap;
+    const C ai = a[i - 1];
+    for (std::size_t j = lo; j <= hi; ++j) {
+      const int cost = ai == b[j - 1] ? 0 : 1;
+      int d = std::min(std::min(prev[j] + 1, cur[j - 1] + 1), prev[j - 1] + cost);
+      if (i > 1 && j > 1 && ai == b[j - 2] && a[i - 2] == b[j - 1]) {
+        d = std::min(d, prev2[j - 2] + 1);
+      }
+      if (d > cap) d = cap;
+      cur[j] = d;
+      if (d < row_min) row_min = d;
+    }
+
+    // later rows derive from this row (+0 or more) and the previous row
+    // (+1 via transposition), so they cannot come back within the bound
+    if (row_min > bound && prev_min >= bound) return cap;
+
+    prev_min = row_min;
+    int* tmp = prev2;
+    prev2 = prev;
+    prev = cur;
+    cur = tmp;
+  }
+
+  return prev[nb];
+}
+
+// capped OSA distances between each prefix a[0, ends[k]) and b, i.e.
+// min(osa_dist(a[0, ends[k]), b), bound + 1) for ascending ends[0..n_ends),
+// written to out[k]. The DP rows of a prefix are shared by every longer
+// prefix, so all distances come from a single pass over the longest one. As
+// in osa_dist_bounded(), a path through cell (i, j) costs at least |i - j|, so
+// only the band |i - j| <= bound is computed, and the pass stops once a row
+// lies entirely above the bound
+template <typename C>
+void osa_dist_prefixes(const C* a, const std::size_t* ends, int n_ends,
+                       const C* b, std::size_t nb, int bound,
+                       std::vector<int>& work, int* out) {
+  if (n_ends <= 0) return;
+  const int cap = bound + 1;
+  for (int k = 0; k < n_ends; ++k) out[k] = cap;
+
+  const std::size_t w = nb + 1;
+  work.assign(3 * w, cap);
+  int* prev2 = work.data();
+  int* prev = prev2 + w;
+  int* cur = prev + w;
+
+  for (std::size_t j = 0; j <= nb && static_cast<int>(j) <= bound; ++j) {
+    prev[j] = static_cast<int>(j);
+  }
+  int prev_min = 0;
+
+  int k = 0;
+  while (k < n_ends && ends[k] == 0) out[k++] = std::min(static_cast<int>(nb), cap);
+
+  const std::size_t ub = static_cast<std::size_t>(bound);
+  const std::size_t na = ends[n_ends - 1];
+  for (std::size_t i = 1; i <= na; ++i) {
+    const std::size_t lo = i > ub ? i - ub : 1;
+    const std::size_t hi = i + ub < nb ? i + ub : nb;
+
+    cur[0] = i < static_cast<std::size_t>(cap) ? static_cast<int>(i) : cap;
+    if (lo > 1) cur[lo - 1] = cap;
+    if (hi < nb) cur[hi + 1] = cap;
+
+    int row_min = lo == 1 ? cur[0] : cap;
+    const C ai = a[i - 1];
+    for (std::size_t j = lo; j <= hi; ++j) {
+      const int cost = ai == b[j - 1] ? 0 : 1;
+      int d = std::min(std::min(prev[j] + 1, cur[j - 1] + 1), prev[j - 1] + cost);
+      if (i > 1 && j > 1 && ai == b[j - 2] && a[i - 2] == b[j - 1]) {
+        d = std::min(d, prev2[j - 2] + 1);
+      }
+      if (d > cap) d = cap;
+      cur[j] = d;
+      if (d < row_min) row_min = d;
+    }
+
+    if (row_min > bound && prev_min >= bound) return;
+
+    prev_min = row_min;
+    int* tmp = prev2;
+    prev2 = prev;
+    prev = cur;
+    cur = tmp;
+    while (k < n_ends && ends[k] == i) out[k++] = prev[nb];
+  }
+}
+
+} // namespace nmatch
+
+#endif
@@ -0,0 +1,110 @@
+// SIMD kernel for batches of OSA distances. Included by osa_simd.h once per
+// instruction set, with NMATCH_SIMD_NS (namespace) and NMATCH_SIMD_LANES
+// (number of 16-bit lanes) defined, so deliberately has no include guard
+
+namespace nmatch {
+namespace NMATCH_SIMD_NS {
+
+// signed, so that the minimum maps onto a single instruction even with SSE2;
+// distances are capped well below 0x7FFF
+typedef std::int16_t lanes_t __attribute__((vector_size(NMATCH_SIMD_LANES * 2)));
+
+inline lanes_t broadcast(int x) {
+  return lanes_t{} + static_cast<std::int16_t>(x);
+}
+
+inline lanes_t vmin(lanes_t x, lanes_t y) {
+  return x < y ? x : y;
+}
+
+inline bool any(lanes_t x) {
+  std::uint64_t w[sizeof(lanes_t) / 8];
+  std::memcpy(w, &x, sizeof(w));
+  std::uint64_t r = 0;
+  for (std::size_t i = 0; i < sizeof(lanes_t) / 8; ++i) r |= w[i];
+  return r != 0;
+}
+
+// min(OSA distance, cap) for n token pairs that all have lengths na and nb
+// (1 <= na, nb <= osa_batch_max_len, cap <= 0x7FFF), as osa_dist_bounded()
+// with bound = cap - 1. Characters are stored position-major: a[p * stride + l] is
+// character p of the a-token of pair l, with stride a multiple of
+// NMATCH_SIMD_LANES and lanes beyond n padded. Each group of lanes runs the
+// scalar DP in lockstep; since all lanes share the same lengths, they also
+// share the diagonal band, and a group stops once no lane can come back
+// within the bound
+inline void osa_batch(const std::uint16_t* a, const std::uint16_t* b, int na, int nb,
+                      std::size_t stride, std::size_t n, std::uint16_t cap,
+                      std::uint16_t* out) {
+  const int lanes = NMATCH_SIMD_LANES;
+  const int bound = cap - 1;
+  if (na - nb > bound || nb - na > bound) {
+    for (std::size_t l = 0; l < n; ++l) out[l] = cap;
+    return;
+  }
+
+  lanes_t av[osa_batch_max_len], bv[osa_batch_max_len];
+  lanes_t rows[3][osa_batch_max_len + 1];
+  const lanes_t one = broadcast(1);
+  const lanes_t capv = broadcast(cap);
+  const lanes_t boundv = broadcast(bound);
+  const lanes_t maxv = broadcast(0x7FFF);
+
+  for (std::size_t base = 0; base < n; base += lanes) {
+    for (int p = 0; p < na; ++p) std::memcpy(&av[p], a + p * stride + base, sizeof(lanes_t));
+    for (int p = 0; p < nb; ++p) std::memcpy(&bv[p], b + p * stride + base, sizeof(lanes_t));
+
+    lanes_t* prev2 = rows[0];
+    lanes_t* prev = rows[1];
+    lanes_t* cur = rows[2];
+    for (int j = 0; j <= nb; ++j) prev[j] = vmin(broadcast(j), capv);
+    lanes_t prev_min = lanes_t{};
+    lanes_t res = capv;
+    bool done = false;
+
+    for (int i = 1; i <= na && !done; ++i) {
+      const int lo = i > bound ? i - bound : 1;
+      const int hi = i + bound < nb ? i + bound : nb;
+      cur[0] = vmin(broadcast(i), capv);
+      if (lo > 1) cur[lo - 1] = capv;
+      if (hi < nb) cur[hi + 1] = capv;
+
+      lanes_t row_min = lo == 1 ? cur[0] : capv;
+      const lanes_t ai = av[i - 1];
+      for (int j = lo; j <= hi; ++j) {
+        // everything but the insertion first, keeping the dependency on
+        // cur[j - 1] (which serializes the row) to one add and one min. Cells
+        // are not capped: any value >= cap gives the same capped result
+        const lanes_t eq = (lanes_t) (ai == bv[j - 1]);
+        lanes_t d = vmin(prev[j] + one, prev[j - 1] + (~eq & one));
+        if (i > 1 && j > 1) {
+          // transposition where a[i-1] == b[j-2] and a[i-2] == b[j-1]; lanes
+          // without one get 0x7FFF, which never wins the minimum
+          const lanes_t t = (lanes_t) (ai == bv[j - 2]) & (lanes_t) (av[i - 2] == bv[j - 1]);
+          d = vmin(d, (prev2[j - 2] + one) | (~t & maxv));
+        }
+        d = vmin(d, cur[j - 1] + one);
+        cur[j] = d;
+        row_min = vmin(row_min, d);
+      }
+
+      // as in osa_dist_bounded(), but only once every lane is out of reach
+      done = !any((lanes_t) (row_min <= boundv) | (lanes_t) (prev_min < boundv));
+
+      prev_min = row_min;
+      lanes_t* tmp = prev2;
+      prev2 = prev;
+      prev = cur;
+      cur = tmp;
+    }
+    if (!done) res = vmin(prev[nb], capv);
+
+    std::uint16_t r[NMATCH_SIMD_LANES];
+    std::memcpy(r, &res, sizeof(r));
+    const std::size_t m = n - base < static_cast<std::size_t>(lanes) ? n - base : lanes;
+    std::memcpy(out + base, r, m * sizeof(std::uint16_t));
+  }
+}
+
+} // namespace NMATCH_SIMD_NS
+} // namespace nmatch
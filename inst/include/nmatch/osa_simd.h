@@ -0,0 +1,102 @@
+#ifndef NMATCH_OSA_SIMD_H
+#define NMATCH_OSA_SIMD_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Batched OSA kernels computing many independent token distances at once,
+// one token pair per 16-bit lane. A portable kernel is always built (SSE2 on
+// x86-64, NEON on arm64, via compiler vector extensions); on x86 with GCC or
+// Clang, AVX2 and AVX-512BW kernels are also built and chosen at runtime
+
+namespace nmatch {
+
+// longest token handled by the batched kernels; longer tokens use osa_dist()
+const int osa_batch_max_len = 32;
+
+typedef void (*osa_batch_fn)(const std::uint16_t* a, const std::uint16_t* b,
+                             int na, int nb, std::size_t stride, std::size_t n,
+                             std::uint16_t cap, std::uint16_t* out);
+
+struct osa_batch_kernel {
+  const char* isa;
+  int lanes;
+  osa_batch_fn fn;
+};
+
+} // namespace nmatch
+
+#if defined(__GNUC__)
+
+#define NMATCH_SIMD_NS simd_base
+#define NMATCH_SIMD_LANES 8
+#include "osa_batch_impl.h"
+#undef NMATCH_SIMD_NS
+#undef NMATCH_SIMD_LANES
+
+#if defined(__x86_64__) || defined(__i386__)
+#define NMATCH_SIMD_X86 1
+
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+#define NMATCH_SIMD_NS simd_avx2
+#define NMATCH_SIMD_LANES 16
+#include "osa_batch_impl.h"
+#undef NMATCH_SIMD_NS
+#undef NMATCH_SIMD_LANES
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx512f,avx512bw"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx512bw")
+#endif
+#define NMATCH_SIMD_NS simd_avx512
+#define NMATCH_SIMD_LANES 32
+#include "osa_batch_impl.h"
+#undef NMATCH_SIMD_NS
+#undef NMATCH_SIMD_LANES
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+#endif // x86
+#endif // __GNUC__
+
+namespace nmatch {
+
+// the widest kernel supported by this CPU, or a kernel with fn = nullptr if
+// the compiler has no vector extensions
+inline osa_batch_kernel osa_batch_select() {
+#if defined(NMATCH_SIMD_X86)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512bw")) return {"avx512bw", 32, &simd_avx512::osa_batch};
+  if (__builtin_cpu_supports("avx2")) return {"avx2", 16, &simd_avx2::osa_batch};
+  return {"sse2", 8, &simd_base::osa_batch};
+#elif defined(__GNUC__)
+  return {"generic", 8, &simd_base::osa_batch};
+#else
+  return {"none", 1, nullptr};
+#endif
+}
+
+inline const osa_batch_kernel& osa_batch_default() {
+  static const osa_batch_kernel k = osa_batch_select();
+  return k;
+}
+
+} // namespace nmatch
+
+#endif
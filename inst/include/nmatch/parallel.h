@@ -0,0 +1,57 @@
+#ifndef NMATCH_PARALLEL_H
+#define NMATCH_PARALLEL_H
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <thread>
+#include <vector>
+
+namespace nmatch {
+
+// run f(thread, begin, end) over [0, n) in blocks of `block` items, handed
+// out dynamically to `n_threads` threads so that slow blocks (e.g. names with
+// many tokens) do not hold up the others. f must not call the R API. The
+// first exception thrown by any thread is rethrown on the calling thread
+template <typename F>
+void parallel_for(std::size_t n, int n_threads, F f, std::size_t block = 1024) {
+  if (n_threads <= 1 || n <= block) {
+    f(0, std::size_t(0), n);
+    return;
+  }
+
+  const std::size_t n_blocks = (n + block - 1) / block;
+  if (static_cast<std::size_t>(n_threads) > n_blocks) n_threads = static_cast<int>(n_blocks);
+
+  std::atomic<std::size_t> next(0);
+  std::vector<std::exception_ptr> errors(n_threads);
+
+  auto worker = [&](int thread) {
+    try {
+      for (;;) {
+        const std::size_t b = next.fetch_add(1);
+        if (b >= n_blocks) break;
+        const std::size_t begin = b * block;
+        const std::size_t end = begin + block < n ? begin + block : n;
+        f(thread, begin, end);
+      }
+    } catch (...) {
+      errors[thread] = std::current_exception();
+      next.store(n_blocks);
+    }
+  };
+
+  std::vector<std::thread> threads;
+  threads.reserve(n_threads - 1);
+  for (int t = 1; t < n_threads; ++t) threads.emplace_back(worker, t);
+  worker(0);
+  for (std::thread& t : threads) t.join();
+
+  for (const std::exception_ptr& e : errors) {
+    if (e) std::rethrow_exception(e);
+  }
+}
+
+} // namespace nmatch
+
+#endif
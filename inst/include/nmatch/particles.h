@@ -0,0 +1,143 @@
+#ifndef NMATCH_PARTICLES_H
+#define NMATCH_PARTICLES_H
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+#include "tokens.h"
+
+namespace nmatch {
+
+// name particles and titles dropped from names by token_filter, upper case
+// (as after name_standardize()). Words that are also common names on their
+// own (e.g. LE, DO, the Vietnamese surnames) are left out
+constexpr const char* name_particles[] = {
+  // particles
+  "AL", "EL", "BEN", "BIN", "BINT", "IBN", "ABU", "ABOU", "UMM", "DE", "DA",
+  "DOS", "DAS", "DEL", "DELLA", "DER", "DEN", "DU", "VAN", "VON", "TER", "TEN",
+  // titles and suffixes
+  "MR", "MRS", "MS", "MISS", "MME", "MLLE", "DR", "PROF", "SIR", "JR", "SR",
+  "II", "III", "IV", "HAJ", "HAJJ", "HAJI", "SHEIKH"
+};
+
+constexpr std::size_t n_name_particles = sizeof(name_particles) / sizeof(name_particles[0]);
+
+// length in characters of the shortest and longest particles
+constexpr std::size_t particle_len_min = 2;
+constexpr std::size_t particle_len_max = 6;
+
+// perfect hash of the particles: their first, second and last characters and
+// length map each to a distinct one of 64 slots (checked at compile time
+// below), so a token is looked up with a single probe
+constexpr std::size_t particle_slots = 64;
+
+constexpr std::size_t particle_slot(char32_t first, char32_t second, char32_t last, std::size_t n) {
+  return (first + 9 * second + 37 * last + n) & (particle_slots - 1);
+}
+
+constexpr std::size_t cstr_len(const char* s) {
+  std::size_t n = 0;
+  while (s[n] != '\0') ++n;
+  return n;
+}
+
+constexpr std::size_t particle_slot(const char* s) {
+  const std::size_t n = cstr_len(s);
+  return particle_slot(static_cast<unsigned char>(s[0]), static_cast<unsigned char>(s[1]),
+                       static_cast<unsigned char>(s[n - 1]), n);
+}
+
+// particles by slot, nullptr for empty slots
+constexpr std::array<const char*, particle_slots> particle_table() {
+  std::array<const char*, particle_slots> table{};
+  for (std::size_t i = 0; i < n_name_particles; ++i) {
+    table[particle_slot(name_particles[i])] = name_particles[i];
+  }
+  return table;
+}
+
+constexpr bool particle_hash_is_perfect() {
+  std::array<bool, particle_slots> used{};
+  for (std::size_t i = 0; i < n_name_particles; ++i) {
+    const std::size_t n = cstr_len(name_particles[i]);
+    if (n < particle_len_min || n > particle_len_max) return false;
+    const std::size_t slot = particle_slot(name_particles[i]);
+    if (used[slot]) return false;
+    used[slot] = true;
+  }
+  return true;
+}
+
+static_assert(particle_hash_is_perfect(),
+              "name particles must have distinct slots and lengths within bounds");
+
+constexpr std::array<const char*, particle_slots> particle_by_slot = particle_table();
+
+// whether `t` is one of name_particles
+inline bool is_name_particle(token_view t) {
+  const std::size_t n = t.size();
+  if (n < particle_len_min || n > particle_len_max) return false;
+  const char* p = particle_by_slot[particle_slot(t[0], t[1], t[n - 1], n)];
+  if (p == nullptr) return false;
+  for (std::size_t i = 0; i < n; ++i) {
+    if (p[i] == '\0' || static_cast<unsigned char>(p[i]) != t[i]) return false;
+  }
+  return p[n] == '\0';
+}
+
+// set of tokens to drop from names at tokenization: optionally the built-in
+// name_particles, and extra tokens given at run time, kept in an
+// open-addressing hash table (linear probing, at most half full)
+class token_filter {
+public:
+  token_filter() : arena_(256) {}
+
+  void use_builtin(bool builtin) { builtin_ = builtin; }
+
+  void add(token_view t) {
+    if (t.empty() || contains_extra(t)) return;
+    if (2 * (n_extra_ + 1) > slots_.size()) rehash(slots_.empty() ? 16 : 2 * slots_.size());
+    insert(arena_.store(t.data(), t.size()));
+    ++n_extra_;
+  }
+
+  // whether the filter drops no token
+  bool empty() const { return !builtin_ && n_extra_ == 0; }
+
+  bool contains(token_view t) const {
+    return (builtin_ && is_name_particle(t)) || (n_extra_ > 0 && contains_extra(t));
+  }
+
+private:
+  bool contains_extra(token_view t) const {
+    if (slots_.empty()) return false;
+    const std::size_t mask = slots_.size() - 1;
+    for (std::size_t i = name_tokens::token_hash(t) & mask; !slots_[i].empty(); i = (i + 1) & mask) {
+      if (slots_[i] == t) return true;
+    }
+    return false;
+  }
+
+  void insert(token_view t) {
+    const std::size_t mask = slots_.size() - 1;
+    std::size_t i = name_tokens::token_hash(t) & mask;
+    while (!slots_[i].empty()) i = (i + 1) & mask;
+    slots_[i] = t;
+  }
+
+  void rehash(std::size_t size) {
+    std::vector<token_view> old(size);
+    old.swap(slots_);
+    for (token_view t : old) if (!t.empty()) insert(t);
+  }
+
+  bool builtin_ = false;
+  token_arena arena_;
+  std::vector<token_view> slots_; // empty views mark free slots
+  std::size_t n_extra_ = 0;
+};
+
+} // namespace nmatch
+
+#endif
@@ -0,0 +1,122 @@
+#ifndef NMATCH_PROFILE_H
+#define NMATCH_PROFILE_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace nmatch {
+
+typedef std::chrono::steady_clock profile_clock;
+
+// compiled stages of a matching call
+enum stage {
+  STAGE_PREPARE = 0, // decoding tokens and computing signatures
+  STAGE_DISTANCE,    // token distance matrices
+  STAGE_ALIGN,       // token alignment, and classification when done natively
+  N_STAGES
+};
+
+inline const char* stage_name(int s) {
+  static const char* names[N_STAGES] = {"prepare", "distance", "alignment"};
+  return names[s];
+}
+
+// a block of pairs processed by one thread, for timeline export
+struct trace_event {
+  int thread;
+  double start_us;
+  double dur_us;
+  std::uint64_t pairs;
+  double stage_us[N_STAGES];
+};
+
+// opt-in per-thread timing and allocation tracking. Stage times are thread
+// time (summed over threads when merged); allocation is the growth of
+// engine-owned buffers, in bytes and in number of allocations
+struct match_profile {
+  profile_clock::time_point origin;
+  double stage_ns[N_STAGES] = {};
+  std::uint64_t alloc_bytes[N_STAGES] = {};
+  std::uint64_t allocs[N_STAGES] = {};
+  std::vector<trace_event> events;
+
+  explicit match_profile(profile_clock::time_point origin_ = profile_clock::now())
+    : origin(origin_) {}
+
+  double since_origin_us(profile_clock::time_point t) const {
+    return std::chrono::duration<double, std::micro>(t - origin).count();
+  }
+
+  // record a buffer that may have been reallocated: if its capacity grew,
+  // the new capacity counts as allocated
+  void note_capacity(int s, std::size_t before, std::size_t after, std::size_t elem_size) {
+    if (after <= before) return;
+    alloc_bytes[s] += after * elem_size;
+    ++allocs[s];
+  }
+
+  match_profile& operator+=(const match_profile& other) {
+    for (int s = 0; s < N_STAGES; ++s) {
+      stage_ns[s] += other.stage_ns[s];
+      alloc_bytes[s] += other.alloc_bytes[s];
+      allocs[s] += other.allocs[s];
+    }
+    events.insert(events.end(), other.events.begin(), other.events.end());
+    return *this;
+  }
+};
+
+// adds the time spent in its scope to a stage; a no-op if profile is null
+class stage_timer {
+public:
+  stage_timer(match_profile* profile, int s) : profile_(profile), stage_(s) {
+    if (profile_) start_ = profile_clock::now();
+  }
+
+  ~stage_timer() {
+    if (profile_) {
+      profile_->stage_ns[stage_] +=
+        std::chrono::duration<double, std::nano>(profile_clock::now() - start_).count();
+    }
+  }
+
+private:
+  match_profile* profile_;
+  int stage_;
+  profile_clock::time_point start_;
+};
+
+// records a trace event for a block of pairs processed by one thread
+class block_timer {
+public:
+  block_timer(match_profile* profile, int thread, std::uint64_t pairs)
+    : profile_(profile), thread_(thread), pairs_(pairs) {
+    if (!profile_) return;
+    start_ = profile_clock::now();
+    for (int s = 0; s < N_STAGES; ++s) stage_ns_[s] = profile_->stage_ns[s];
+  }
+
+  ~block_timer() {
+    if (!profile_) return;
+    trace_event e;
+    e.thread = thread_;
+    e.start_us = profile_->since_origin_us(start_);
+    e.dur_us = std::chrono::duration<double, std::micro>(profile_clock::now() - start_).count();
+    e.pairs = pairs_;
+    for (int s = 0; s < N_STAGES; ++s) e.stage_us[s] = (profile_->stage_ns[s] - stage_ns_[s]) / 1e3;
+    profile_->events.push_back(e);
+  }
+
+private:
+  match_profile* profile_;
+  int thread_;
+  std::uint64_t pairs_;
+  profile_clock::time_point start_;
+  double stage_ns_[N_STAGES];
+};
+
+} // namespace nmatch
+
+#endif
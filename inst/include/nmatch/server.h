@@ -0,0 +1,430 @@
+#ifndef NMATCH_SERVER_H
+#define NMATCH_SERVER_H
+
+// Local matching server: answers search and match requests for a name_index
+// over a Unix domain socket, from threads that never enter R.
+//
+// Wire format. Requests and responses are lines of UTF-8 text terminated by
+// "\n" (a trailing "\r" is ignored), with fields separated by tabs, so names
+// cannot contain tabs or line breaks. A client may send any number of
+// requests on a connection, without waiting for responses, and responses come
+// back in the order of the requests. The client must keep reading responses
+// while it sends requests (see line_reader::send_while_reading()), since the
+// server stops reading requests while its responses are not read:
+//
+//   PING                       -> PONG
+//   SEARCH <name>              -> one line per matching live record
+//                                   HIT <id> <k_x> <k_y> <k_align> <n_match> <dist_total>
+//                                 in ascending order of id, then
+//                                   END
+//   MATCH <name_x> <name_y>    -> MATCH <is_match> <k_x> <k_y> <k_align> <n_match> <dist_total>
+//   anything else              -> ERR <message>
+//
+// Names are standardized and tokenized by standardize_tokens(). Record ids
+// are 1-based, as in R. is_match is 0 or 1; for a name without tokens the
+// summary fields are 0 and dist_total is NA. Each SEARCH reads a single
+// snapshot of the index, so records appended while the server runs are
+// visible to the requests that follow the update
+
+#ifndef _WIN32
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "engine.h"
+#include "eval.h"
+#include "index.h"
+#include "standardize.h"
+
+namespace nmatch {
+
+// send all of `data`, returning false if the peer is gone
+inline bool socket_send_all(int fd, const char* data, std::size_t n) {
+#ifdef MSG_NOSIGNAL
+  const int flags = MSG_NOSIGNAL;
+#else
+  const int flags = 0;
+#endif
+  while (n > 0) {
+    const ssize_t w = ::send(fd, data, n, flags);
+    if (w < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    data += w;
+    n -= static_cast<std::size_t>(w);
+  }
+  return true;
+}
+
+// connected stream socket at `path`, or -1 with errno set
+inline int socket_connect(const std::string& path) {
+  sockaddr_un addr;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  std::memcpy(addr.sun_path, path.c_str(), path.size());
+  const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) return -1;
+#ifdef SO_NOSIGPIPE
+  int one = 1;
+  ::setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+  if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+    const int e = errno;
+    ::close(fd);
+    errno = e;
+    return -1;
+  }
+  return fd;
+}
+
+// reads "\n"-terminated lines from a socket, optionally sending data on it
+// at the same time (see send_while_reading())
+class line_reader {
+public:
+  explicit line_reader(int fd) : fd_(fd) {}
+
+  // send `data` as the socket accepts it while next() waits for lines. A
+  // client pipelining requests to a peer that answers them as they come (as
+  // match_server does) must read responses while it sends requests, or both
+  // sides block once the responses fill the socket buffers
+  void send_while_reading(std::string data) {
+    pending_ = std::move(data);
+    sent_ = 0;
+  }
+
+  // next line, without its terminator; false at end of stream or on error
+  bool next(std::string& line) {
+    for (;;) {
+      const std::size_t nl = buf_.find('\n', pos_);
+      if (nl != std::string::npos) {
+        std::size_t end = nl;
+        if (end > pos_ && buf_[end - 1] == '\r') --end;
+        line.assign(buf_, pos_, end - pos_);
+        pos_ = nl + 1;
+        return true;
+      }
+      if (pos_ > 0) {
+        buf_.erase(0, pos_);
+        pos_ = 0;
+      }
+      if (sent_ < pending_.size()) {
+        const int readable = send_pending();
+        if (readable < 0) return false;
+        if (readable == 0) continue;
+      }
+      char chunk[65536];
+      const ssize_t r = ::recv(fd_, chunk, sizeof(chunk), 0);
+      if (r < 0 && errno == EINTR) continue;
+      if (r <= 0) return false;
+      buf_.append(chunk, static_cast<std::size_t>(r));
+    }
+  }
+
+  // whether a complete line is already buffered, i.e. next() would not block
+  bool buffered() const { return buf_.find('\n', pos_) != std::string::npos; }
+
+private:
+  // wait until the socket is readable or writable, sending what it accepts
+  // of the pending data if writable. Returns 1 if readable (or closed), 0 if
+  // not yet and -1 on error
+  int send_pending() {
+#ifdef MSG_NOSIGNAL
+    const int flags = MSG_DONTWAIT | MSG_NOSIGNAL;
+#else
+    const int flags = MSG_DONTWAIT;
+#endif
+    pollfd fds;
+    fds.fd = fd_;
+    fds.events = POLLIN | POLLOUT;
+    if (::poll(&fds, 1, -1) < 0) return errno == EINTR ? 0 : -1;
+    if (fds.revents & (POLLIN | POLLHUP | POLLERR)) return 1;
+    if (!(fds.revents & POLLOUT)) return 0;
+    const ssize_t w = ::send(fd_, pending_.data() + sent_, pending_.size() - sent_, flags);
+    if (w < 0) return errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+    sent_ += static_cast<std::size_t>(w);
+    if (sent_ == pending_.size()) {
+      std::string().swap(pending_);
+      sent_ = 0;
+    }
+    return 0;
+  }
+
+  int fd_;
+  std::string buf_;
+  std::size_t pos_ = 0;
+  std::string pending_;
+  std::size_t sent_ = 0;
+};
+
+struct server_config {
+  match_params params;
+  edit_costs costs;
+  eval_rule rule;
+  int nchar_min = 2;
+  // for OSA, the integer distance bound used by the index pre-filters
+  int osa_bound = -1;
+};
+
+class match_server {
+public:
+  match_server(std::shared_ptr<name_index> index, const server_config& config)
+    : index_(std::move(index)), config_(config) {
+    config_.params.costs = &config_.costs;
+  }
+
+  match_server(const match_server&) = delete;
+  match_server& operator=(const match_server&) = delete;
+
+  ~match_server() { stop(); }
+
+  const std::string& path() const { return path_; }
+  bool running() const { return listen_fd_ >= 0; }
+  std::uint64_t n_requests() const { return n_requests_; }
+
+  // listen on a new socket at `path` and start accepting connections.
+  // Throws std::runtime_error if the socket cannot be created
+  void start(const std::string& path) {
+    if (running()) throw std::runtime_error("server is already running");
+    sockaddr_un addr;
+    if (path.size() >= sizeof(addr.sun_path)) throw std::runtime_error("socket path is too long");
+
+    // a stale socket left by a server that did not shut down cleanly is
+    // replaced, but not any other kind of file
+    struct stat st;
+    if (::lstat(path.c_str(), &st) == 0) {
+      if (!S_ISSOCK(st.st_mode)) throw std::runtime_error("socket path exists and is not a socket");
+      const int probe = socket_connect(path);
+      if (probe >= 0) {
+        ::close(probe);
+        throw std::runtime_error("a server is already listening at socket path");
+      }
+      ::unlink(path.c_str());
+    }
+
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, path.c_str(), path.size());
+
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) throw std::runtime_error(error_message("socket"));
+    if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(fd, 64) != 0) {
+      const std::string msg = error_message("bind");
+      ::close(fd);
+      throw std::runtime_error(msg);
+    }
+    if (::pipe(wake_) != 0) {
+      const std::string msg = error_message("pipe");
+      ::close(fd);
+      ::unlink(path.c_str());
+      throw std::runtime_error(msg);
+    }
+
+    path_ = path;
+    listen_fd_ = fd;
+    stopping_ = false;
+    accept_thread_ = std::thread([this] { accept_loop(); });
+  }
+
+  // stop accepting, close all connections, and remove the socket
+  void stop() {
+    if (!running()) return;
+    stopping_ = true;
+    const char wake = 0;
+    while (::write(wake_[1], &wake, 1) < 0 && errno == EINTR) {}
+    accept_thread_.join();
+
+    {
+      std::lock_guard<std::mutex> lock(conn_mutex_);
+      for (connection& c : connections_) if (c.fd >= 0) ::shutdown(c.fd, SHUT_RDWR);
+    }
+    for (connection& c : connections_) c.thread.join();
+    connections_.clear();
+
+    ::close(listen_fd_);
+    ::close(wake_[0]);
+    ::close(wake_[1]);
+    ::unlink(path_.c_str());
+    listen_fd_ = -1;
+  }
+
+  // response to a single request line, appended to `out`
+  void respond(const std::string& line, matcher& m, std::vector<token_t>& work,
+               token_arena& arena, std::vector<index_hit>& hits, index_search_work& search_work,
+               std::string& out) {
+    ++n_requests_;
+    arena.clear();
+    const std::size_t tab = line.find('\t');
+    const std::string cmd = line.substr(0, tab);
+    const char* arg = tab == std::string::npos ? nullptr : line.c_str() + tab + 1;
+    const std::size_t arg_n = tab == std::string::npos ? 0 : line.size() - tab - 1;
+
+    if (cmd == "PING" && arg == nullptr) {
+      out += "PONG\n";
+    } else if (cmd == "SEARCH" && arg != nullptr && std::memchr(arg, '\t', arg_n) == nullptr) {
+      const name_tokens q = standardize_tokens(arg, arg_n, config_.nchar_min, work, arena);
+      pair_summary s;
+      if (q.valid()) {
+        const std::shared_ptr<const index_snapshot> snap = index_->snapshot();
+        snap->search(q, m, config_.osa_bound, config_.rule.n_match_threshold_min(q.k()), hits, search_work);
+        for (const index_hit& h : hits) {
+          // candidates with too few matching tokens are not summarized
+          if (config_.rule.uses_threshold() &&
+              h.n_shared < config_.rule.n_match_threshold(q.k(), h.name->k())) continue;
+          m.summarize(q, *h.name, s);
+          if (!config_.rule(s)) continue;
+          out += "HIT\t";
+          out += std::to_string(h.id + 1);
+          append_summary(s, out);
+        }
+      }
+      out += "END\n";
+    } else if (cmd == "MATCH" && arg != nullptr) {
+      const char* sep = static_cast<const char*>(std::memchr(arg, '\t', arg_n));
+      if (sep == nullptr || std::memchr(sep + 1, '\t', arg + arg_n - sep - 1) != nullptr) {
+        out += "ERR\tMATCH takes two names\n";
+        return;
+      }
+      const name_tokens x = standardize_tokens(arg, sep - arg, config_.nchar_min, work, arena);
+      const name_tokens y = standardize_tokens(sep + 1, arg + arg_n - sep - 1, config_.nchar_min, work, arena);
+      pair_summary s;
+      m.summarize(x, y, s);
+      out += config_.rule(s) ? "MATCH\t1" : "MATCH\t0";
+      append_summary(s, out);
+    } else {
+      out += "ERR\tunknown request\n";
+    }
+  }
+
+private:
+  struct connection {
+    int fd;
+    std::thread thread;
+    std::atomic<bool> done{false};
+  };
+
+  static std::string error_message(const char* what) {
+    return std::string(what) + ": " + std::strerror(errno);
+  }
+
+  void append_summary(const pair_summary& s, std::string& out) const {
+    char buf[96];
+    if (s.valid) {
+      if (config_.params.method == DIST_OSA) {
+        std::snprintf(buf, sizeof(buf), "\t%d\t%d\t%d\t%d\t%d\n",
+                      s.k_x, s.k_y, s.k_align, s.n_match, static_cast<int>(s.dist_total));
+      } else {
+        std::snprintf(buf, sizeof(buf), "\t%d\t%d\t%d\t%d\t%.17g\n",
+                      s.k_x, s.k_y, s.k_align, s.n_match, s.dist_total);
+      }
+    } else {
+      std::snprintf(buf, sizeof(buf), "\t0\t0\t0\t0\tNA\n");
+    }
+    out += buf;
+  }
+
+  void accept_loop() {
+    pollfd fds[2];
+    fds[0].fd = listen_fd_;
+    fds[0].events = POLLIN;
+    fds[1].fd = wake_[0];
+    fds[1].events = POLLIN;
+    while (!stopping_) {
+      if (::poll(fds, 2, -1) < 0) {
+        if (errno == EINTR) continue;
+        break;
+      }
+      if (stopping_ || (fds[1].revents & POLLIN)) break;
+      if (!(fds[0].revents & POLLIN)) continue;
+      const int fd = ::accept(listen_fd_, nullptr, nullptr);
+      if (fd < 0) continue;
+#ifdef SO_NOSIGPIPE
+      int one = 1;
+      ::setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+
+      std::lock_guard<std::mutex> lock(conn_mutex_);
+      // join the threads of closed connections
+      for (std::list<connection>::iterator it = connections_.begin(); it != connections_.end();) {
+        if (it->done) {
+          it->thread.join();
+          it = connections_.erase(it);
+        } else {
+          ++it;
+        }
+      }
+      connections_.emplace_back();
+      connection& c = connections_.back();
+      c.fd = fd;
+      c.thread = std::thread([this, &c] { serve(c); });
+    }
+  }
+
+  // answer requests on a connection until the client closes it. Responses
+  // to pipelined requests are sent together once no further request is
+  // buffered, or once they reach flush_bytes
+  void serve(connection& c) {
+    const std::size_t flush_bytes = 65536;
+    matcher m(config_.params);
+    std::vector<token_t> work;
+    token_arena arena;
+    std::vector<index_hit> hits;
+    index_search_work search_work;
+    line_reader reader(c.fd);
+    std::string line, out;
+    try {
+      while (reader.next(line)) {
+        respond(line, m, work, arena, hits, search_work, out);
+        if (!reader.buffered() || out.size() >= flush_bytes) {
+          if (!socket_send_all(c.fd, out.data(), out.size())) break;
+          out.clear();
+        }
+      }
+    } catch (const std::exception&) {
+      // e.g. std::bad_alloc: drop the connection, not the process
+    }
+    {
+      std::lock_guard<std::mutex> lock(conn_mutex_);
+      ::close(c.fd);
+      c.fd = -1;
+    }
+    c.done = true;
+  }
+
+  std::shared_ptr<name_index> index_;
+  server_config config_;
+  std::string path_;
+  int listen_fd_ = -1;
+  int wake_[2] = {-1, -1};
+  std::atomic<bool> stopping_{false};
+  std::atomic<std::uint64_t> n_requests_{0};
+  std::thread accept_thread_;
+  std::mutex conn_mutex_;
+  std::list<connection> connections_;
+};
+
+} // namespace nmatch
+
+#endif // _WIN32
+
+#endif
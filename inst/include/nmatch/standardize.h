@@ -0,0 +1,475 @@
+#ifndef NMATCH_STANDARDIZE_H
+#define NMATCH_STANDARDIZE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "tokens.h"
+
+namespace nmatch {
+
+// ASCII transliterations of the Latin-1 Supplement and Latin Extended-A
+// letters U+00C0 to U+017F as name_standardize() gives them: upper-cased by
+// toupper() (which leaves letters such as U+00DF sharp s unchanged),
+// transliterated by ICU's Latin-ASCII transform, then upper-cased again. An
+// empty string marks a symbol (U+00D7, U+00F7), treated as punctuation, and
+// the apostrophe of U+0149 splits the token as punctuation does
+const char latin_ascii[192][3] = {
+  "A", "A", "A", "A", "A", "A", "AE", "C", "E", "E", "E", "E",
+  "I", "I", "I", "I", "D", "N", "O", "O", "O", "O", "O", "",
+  "O", "U", "U", "U", "U", "Y", "TH", "SS", "A", "A", "A", "A",
+  "A", "A", "AE", "C", "E", "E", "E", "E", "I", "I", "I", "I",
+  "D", "N", "O", "O", "O", "O", "O", "", "O", "U", "U", "U",
+  "U", "Y", "TH", "Y", "A", "A", "A", "A", "A", "A", "C", "C",
+  "C", "C", "C", "C", "C", "C", "D", "D", "D", "D", "E", "E",
+  "E", "E", "E", "E", "E", "E", "E", "E", "G", "G", "G", "G",
+  "G", "G", "G", "G", "H", "H", "H", "H", "I", "I", "I", "I",
+  "I", "I", "I", "I", "I", "I", "IJ", "IJ", "J", "J", "K", "K",
+  "Q", "L", "L", "L", "L", "L", "L", "L", "L", "L", "L", "N",
+  "N", "N", "N", "N", "N", "'N", "N", "N", "O", "O", "O", "O",
+  "O", "O", "OE", "OE", "R", "R", "R", "R", "R", "R", "S", "S",
+  "S", "S", "S", "S", "S", "S", "T", "T", "T", "T", "T", "T",
+  "U", "U", "U", "U", "U", "U", "U", "U", "U", "U", "U", "U",
+  "W", "W", "Y", "Y", "Y", "Z", "Z", "Z", "Z", "Z", "Z", "S",
+};
+
+// the same for the Latin Extended-B and IPA Extensions letters U+0180 to
+// U+02AF (e.g. the Romanian S and T with comma below, the West African hooked
+// letters, the Azerbaijani schwa) and the Latin Extended Additional letters
+// U+1E00 to U+1EFF (e.g. Vietnamese vowels with two diacritics). Letters
+// without an ASCII transliteration are given in upper case
+constexpr char32_t latin_extended_b[304][3] = {
+  U"B", U"B", U"B", U"B", U"\u0184", U"\u0184", U"\u0186", U"C",
+  U"C", U"D", U"D", U"D", U"D", U"\u018D", U"\u018E", U"\u018F",
+  U"E", U"F", U"F", U"G", U"\u0194", U"\u01F6", U"I", U"I",
+  U"K", U"K", U"L", U"\u019B", U"\u019C", U"N", U"\u0220", U"\u019F",
+  U"O", U"O", U"OI", U"OI", U"P", U"P", U"\u01A6", U"\u01A7",
+  U"\u01A7", U"\u01A9", U"\u01AA", U"T", U"T", U"T", U"T", U"U",
+  U"U", U"\u01B1", U"V", U"Y", U"Y", U"Z", U"Z", U"\u01B7",
+  U"\u01B8", U"\u01B8", U"\u01BA", U"\u01BB", U"\u01BC", U"\u01BC", U"\u01BE", U"\u01F7",
+  U"\u01C0", U"\u01C1", U"\u01C2", U"\u01C3", U"DZ", U"DZ", U"DZ", U"LJ",
+  U"LJ", U"LJ", U"NJ", U"NJ", U"NJ", U"A", U"A", U"I",
+  U"I", U"O", U"O", U"U", U"U", U"U", U"U", U"U",
+  U"U", U"U", U"U", U"U", U"U", U"\u018E", U"A", U"A",
+  U"A", U"A", U"AE", U"AE", U"G", U"G", U"G", U"G",
+  U"K", U"K", U"O", U"O", U"O", U"O", U"\u01B7", U"\u01B7",
+  U"J", U"DZ", U"DZ", U"DZ", U"G", U"G", U"\u01F6", U"\u01F7",
+  U"N", U"N", U"A", U"A", U"AE", U"AE", U"O", U"O",
+  U"A", U"A", U"A", U"A", U"E", U"E", U"E", U"E",
+  U"I", U"I", U"I", U"I", U"O", U"O", U"O", U"O",
+  U"R", U"R", U"R", U"R", U"U", U"U", U"U", U"U",
+  U"S", U"S", U"T", U"T", U"\u021C", U"\u021C", U"H", U"H",
+  U"\u0220", U"D", U"\u0222", U"\u0222", U"Z", U"Z", U"A", U"A",
+  U"E", U"E", U"O", U"O", U"O", U"O", U"O", U"O",
+  U"O", U"O", U"Y", U"Y", U"L", U"N", U"T", U"J",
+  U"DB", U"QP", U"A", U"C", U"C", U"L", U"T", U"S",
+  U"Z", U"\u0241", U"\u0241", U"B", U"U", U"\u0245", U"E", U"E",
+  U"J", U"J", U"\u024A", U"\u024A", U"R", U"R", U"Y", U"Y",
+  U"\u2C6F", U"\u2C6D", U"\u2C70", U"B", U"\u0186", U"C", U"D", U"D",
+  U"\u0258", U"\u018F", U"\u025A", U"E", U"\uA7AB", U"\u025D", U"\u025E", U"J",
+  U"G", U"\uA7AC", U"G", U"\u0194", U"\u0264", U"\uA78D", U"H", U"H",
+  U"I", U"I", U"\uA7AE", U"L", U"\uA7AD", U"L", U"\u026E", U"\u019C",
+  U"\u0270", U"M", U"N", U"N", U"N", U"\u019F", U"OE", U"\u0277",
+  U"\u0278", U"\u0279", U"\u027A", U"\u027B", U"R", U"R", U"R", U"\u027F",
+  U"\u01A6", U"\u0281", U"\uA7C5", U"\u01A9", U"\u0284", U"\u0285", U"\u0286", U"\uA7B1",
+  U"T", U"U", U"\u01B1", U"V", U"\u0245", U"\u028D", U"\u028E", U"Y",
+  U"Z", U"Z", U"\u01B7", U"\u0293", U"\u0294", U"\u0295", U"\u0296", U"\u0297",
+  U"\u0298", U"B", U"\u029A", U"G", U"H", U"\uA7B2", U"\uA7B0", U"L",
+  U"Q", U"\u02A1", U"\u02A2", U"DZ", U"\u02A4", U"DZ", U"TS", U"\u02A7",
+  U"\u02A8", U"\u02A9", U"LS", U"LZ", U"\u02AC", U"\u02AD", U"\u02AE", U"\u02AF",
+};
+
+constexpr char32_t latin_extended_additional[256][3] = {
+  U"A", U"A", U"B", U"B", U"B", U"B", U"B", U"B",
+  U"C", U"C", U"D", U"D", U"D", U"D", U"D", U"D",
+  U"D", U"D", U"D", U"D", U"E", U"E", U"E", U"E",
+  U"E", U"E", U"E", U"E", U"E", U"E", U"F", U"F",
+  U"G", U"G", U"H", U"H", U"H", U"H", U"H", U"H",
+  U"H", U"H", U"H", U"H", U"I", U"I", U"I", U"I",
+  U"K", U"K", U"K", U"K", U"K", U"K", U"L", U"L",
+  U"L", U"L", U"L", U"L", U"L", U"L", U"M", U"M",
+  U"M", U"M", U"M", U"M", U"N", U"N", U"N", U"N",
+  U"N", U"N", U"N", U"N", U"O", U"O", U"O", U"O",
+  U"O", U"O", U"O", U"O", U"P", U"P", U"P", U"P",
+  U"R", U"R", U"R", U"R", U"R", U"R", U"R", U"R",
+  U"S", U"S", U"S", U"S", U"S", U"S", U"S", U"S",
+  U"S", U"S", U"T", U"T", U"T", U"T", U"T", U"T",
+  U"T", U"T", U"U", U"U", U"U", U"U", U"U", U"U",
+  U"U", U"U", U"U", U"U", U"V", U"V", U"V", U"V",
+  U"W", U"W", U"W", U"W", U"W", U"W", U"W", U"W",
+  U"W", U"W", U"X", U"X", U"X", U"X", U"Y", U"Y",
+  U"Z", U"Z", U"Z", U"Z", U"Z", U"Z", U"H", U"T",
+  U"W", U"Y", U"A", U"S", U"S", U"S", U"SS", U"\u1E9F",
+  U"A", U"A", U"A", U"A", U"A", U"A", U"A", U"A",
+  U"A", U"A", U"A", U"A", U"A", U"A", U"A", U"A",
+  U"A", U"A", U"A", U"A", U"A", U"A", U"A", U"A",
+  U"E", U"E", U"E", U"E", U"E", U"E", U"E", U"E",
+  U"E", U"E", U"E", U"E", U"E", U"E", U"E", U"E",
+  U"I", U"I", U"I", U"I", U"O", U"O", U"O", U"O",
+  U"O", U"O", U"O", U"O", U"O", U"O", U"O", U"O",
+  U"O", U"O", U"O", U"O", U"O", U"O", U"O", U"O",
+  U"O", U"O", U"O", U"O", U"U", U"U", U"U", U"U",
+  U"U", U"U", U"U", U"U", U"U", U"U", U"U", U"U",
+  U"U", U"U", U"Y", U"Y", U"Y", U"Y", U"Y", U"Y",
+  U"Y", U"Y", U"LL", U"LL", U"V", U"V", U"Y", U"Y",
+};
+
+// Latin transliterations of the Cyrillic letters U+0400 to U+042F (the
+// lower case letters U+0430 to U+045F map onto these), following BGN/PCGN
+// romanization for Russian and common usage for the letters of other
+// languages. The hard and soft signs are dropped
+constexpr char cyrillic_latin[48][5] = {
+  "E", "E", "DJ", "G", "YE", "DZ", "I", "YI", "J", "LJ", "NJ", "C",
+  "K", "I", "U", "DZ", "A", "B", "V", "G", "D", "E", "ZH", "Z",
+  "I", "Y", "K", "L", "M", "N", "O", "P", "R", "S", "T", "U",
+  "F", "KH", "TS", "CH", "SH", "SHCH", "", "Y", "", "E", "YU", "YA",
+};
+
+// Latin transliterations of the Arabic letters U+0621 to U+064A. Hamza and
+// ain, often left out of romanized names, are dropped, as is the tatweel
+// (U+0640). Waw and yeh (U+0648, U+064A) are only consonants at the start
+// of a word and are given here as vowels (see arabic_latin_initial)
+constexpr char arabic_latin[42][3] = {
+  "", "A", "A", "U", "I", "I", "A", "B", "A", "T", "TH", "J",
+  "H", "KH", "D", "DH", "R", "Z", "S", "SH", "S", "D", "T", "Z",
+  "", "GH", "K", "K", "Y", "Y", "Y", "", "F", "Q", "K", "L",
+  "M", "N", "H", "U", "A", "I",
+};
+
+// consonants of the Ethiopic syllable rows U+1200, U+1208, ... U+1350 (44
+// rows of 8 syllables, one per vowel order). The glottal rows U+12A0 and
+// U+12D0 have no consonant
+constexpr char ethiopic_consonant[43][3] = {
+  "H", "L", "H", "M", "S", "R", "S", "SH", "Q", "Q", "Q", "Q",
+  "B", "V", "T", "CH", "H", "H", "N", "NY", "", "K", "K", "H",
+  "H", "W", "", "Z", "ZH", "Y", "D", "D", "J", "G", "G", "G",
+  "T", "CH", "P", "TS", "TS", "F", "P",
+};
+
+// vowels of the eight orders of an Ethiopic syllable row, for plain rows,
+// labialized rows (U+1248, U+1258, U+1288, U+12B0, U+12C0, U+1310, whose
+// consonant is followed by w) and the glottal rows
+constexpr char ethiopic_vowel[3][8][3] = {
+  {"E", "U", "I", "A", "E", "", "O", "WA"},
+  {"WE", "", "WI", "WA", "WE", "W", "", ""},
+  {"A", "U", "I", "A", "E", "E", "O", "WA"},
+};
+
+inline bool is_arabic_letter(char32_t c) {
+  return (c >= 0x0620 && c <= 0x063F) || (c >= 0x0641 && c <= 0x064A) || (c >= 0x066E && c <= 0x06D3);
+}
+
+// append to `out` the upper case Latin transliteration of `c`, a letter of
+// the Cyrillic, Arabic or Ethiopic scripts, returning false (appending
+// nothing) if it is none of these. `word_start` tells whether c is the
+// first letter of a word, where Arabic waw and yeh are read as W and Y.
+// Arabic vowel marks and Ethiopic combining marks are dropped, and
+// Arabic-Indic digits replaced with ASCII digits
+template <typename S>
+bool transliterate(char32_t c, bool word_start, S& out) {
+  const char* t = nullptr;
+  char buf[5];
+  if (c >= 0x0400 && c <= 0x045F) {
+    t = cyrillic_latin[c >= 0x0450 ? c - 0x0450 : (c >= 0x0430 ? c - 0x0420 : c - 0x0400)];
+  } else if (c == 0x0490 || c == 0x0491) {
+    t = "G";
+  } else if (c >= 0x0621 && c <= 0x064A) {
+    if (word_start && c == 0x0648) t = "W";
+    else if (word_start && c == 0x064A) t = "Y";
+    else t = arabic_latin[c - 0x0621];
+  } else if ((c >= 0x064B && c <= 0x065F) || c == 0x0670) {
+    t = "";
+  } else if (c >= 0x0660 && c <= 0x0669) {
+    buf[0] = static_cast<char>('0' + (c - 0x0660));
+    buf[1] = 0;
+    t = buf;
+  } else if (c >= 0x0671 && c <= 0x06D3) {
+    switch (c) {
+    case 0x0671: t = "A"; break;
+    case 0x067E: t = "P"; break;
+    case 0x0686: t = "CH"; break;
+    case 0x0698: t = "ZH"; break;
+    case 0x06A9: t = "K"; break;
+    case 0x06AF: t = "G"; break;
+    case 0x06C1: t = "H"; break;
+    case 0x06CC: t = word_start ? "Y" : "I"; break;
+    case 0x06D2: t = "E"; break;
+    default: return false;
+    }
+  } else if (c >= 0x1200 && c <= 0x1357) {
+    const int row = static_cast<int>(c - 0x1200) / 8, order = static_cast<int>(c - 0x1200) % 8;
+    const char* consonant = ethiopic_consonant[row];
+    const int kind = *consonant == 0 ? 2 :
+      (c >= 0x1248 && c < 0x1250) || (c >= 0x1258 && c < 0x1260) || (c >= 0x1288 && c < 0x1290) ||
+      (c >= 0x12B0 && c < 0x12B8) || (c >= 0x12C0 && c < 0x12C8) || (c >= 0x1310 && c < 0x1318);
+    for (const char* p = consonant; *p; ++p) out.push_back(static_cast<typename S::value_type>(*p));
+    t = ethiopic_vowel[kind][order];
+  } else if (c >= 0x1358 && c <= 0x135A) {
+    t = c == 0x1358 ? "MYA" : (c == 0x1359 ? "RYA" : "FYA");
+  } else if (c >= 0x135D && c <= 0x135F) {
+    t = "";
+  } else {
+    return false;
+  }
+  for (; *t; ++t) out.push_back(static_cast<typename S::value_type>(*t));
+  return true;
+}
+
+inline bool is_name_separator(char32_t c) {
+  if (c < 0x80) {
+    return c <= 0x20 || c == 0x7F ||
+      (c >= '!' && c <= '/') || (c >= ':' && c <= '@') ||
+      (c >= '[' && c <= '`') || (c >= '{' && c <= '~');
+  }
+  // Latin-1 spaces, punctuation and symbols, Arabic and Ethiopic
+  // punctuation, and general punctuation
+  return (c >= 0x80 && c <= 0xBF) || c == 0xD7 || c == 0xF7 ||
+    c == 0x060C || c == 0x061B || c == 0x061F || (c >= 0x066A && c <= 0x066D) || c == 0x06D4 ||
+    (c >= 0x1360 && c <= 0x1368) || (c >= 0x2000 && c <= 0x206F) || c == 0x3000;
+}
+
+// the same for the other letters of the Basic Multilingual Plane that the
+// Latin-ASCII transform rewrites (e.g. modifier letter apostrophes, small
+// capitals, Latin Extended-C and -D, ligatures, fullwidth letters), sorted by
+// codepoint
+struct latin_ascii_entry {
+  char32_t c;
+  char32_t ascii[4];
+};
+
+constexpr latin_ascii_entry latin_ascii_other[] = {
+  {0x02B9, U"'"}, {0x02BA, U"\""}, {0x02BB, U"'"}, {0x02BC, U"'"},
+  {0x02BD, U"'"}, {0x02C6, U"^"}, {0x02C8, U"'"}, {0x02CB, U"`"},
+  {0x02D0, U":"}, {0x0374, U"'"}, {0x1D00, U"A"}, {0x1D01, U"AE"},
+  {0x1D03, U"B"}, {0x1D04, U"C"}, {0x1D05, U"D"}, {0x1D06, U"D"},
+  {0x1D07, U"E"}, {0x1D0A, U"J"}, {0x1D0B, U"K"}, {0x1D0C, U"L"},
+  {0x1D0D, U"M"}, {0x1D0F, U"O"}, {0x1D18, U"P"}, {0x1D1B, U"T"},
+  {0x1D1C, U"U"}, {0x1D20, U"V"}, {0x1D21, U"W"}, {0x1D22, U"Z"},
+  {0x1D6B, U"UE"}, {0x1D6C, U"B"}, {0x1D6D, U"D"}, {0x1D6E, U"F"},
+  {0x1D6F, U"M"}, {0x1D70, U"N"}, {0x1D71, U"P"}, {0x1D72, U"R"},
+  {0x1D73, U"R"}, {0x1D74, U"S"}, {0x1D75, U"T"}, {0x1D76, U"Z"},
+  {0x1D7A, U"TH"}, {0x1D7B, U"I"}, {0x1D7D, U"P"}, {0x1D7E, U"U"},
+  {0x1D80, U"B"}, {0x1D81, U"D"}, {0x1D82, U"F"}, {0x1D83, U"G"},
+  {0x1D84, U"K"}, {0x1D85, U"L"}, {0x1D86, U"M"}, {0x1D87, U"N"},
+  {0x1D88, U"P"}, {0x1D89, U"R"}, {0x1D8A, U"S"}, {0x1D8C, U"V"},
+  {0x1D8D, U"X"}, {0x1D8F, U"A"}, {0x1D91, U"D"}, {0x1D92, U"E"},
+  {0x1D93, U"E"}, {0x1D96, U"I"}, {0x1D99, U"U"}, {0x2102, U"C"},
+  {0x210A, U"G"}, {0x210B, U"H"}, {0x210C, U"X"}, {0x210D, U"H"},
+  {0x210E, U"H"}, {0x2110, U"I"}, {0x2111, U"I"}, {0x2112, U"L"},
+  {0x2113, U"L"}, {0x2115, U"N"}, {0x2119, U"P"}, {0x211A, U"Q"},
+  {0x211B, U"R"}, {0x211C, U"R"}, {0x211D, U"R"}, {0x2124, U"Z"},
+  {0x2128, U"Z"}, {0x212A, U"K"}, {0x212B, U"A"}, {0x212C, U"B"},
+  {0x212D, U"C"}, {0x212F, U"E"}, {0x2130, U"E"}, {0x2131, U"F"},
+  {0x2133, U"M"}, {0x2134, U"O"}, {0x2139, U"I"}, {0x2145, U"D"},
+  {0x2146, U"D"}, {0x2147, U"E"}, {0x2148, U"I"}, {0x2149, U"J"},
+  {0x2C60, U"L"}, {0x2C61, U"L"}, {0x2C62, U"L"}, {0x2C63, U"P"},
+  {0x2C64, U"R"}, {0x2C65, U"A"}, {0x2C66, U"T"}, {0x2C67, U"H"},
+  {0x2C68, U"H"}, {0x2C69, U"K"}, {0x2C6A, U"K"}, {0x2C6B, U"Z"},
+  {0x2C6C, U"Z"}, {0x2C6E, U"M"}, {0x2C71, U"V"}, {0x2C72, U"W"},
+  {0x2C73, U"W"}, {0x2C74, U"V"}, {0x2C78, U"E"}, {0x2C7A, U"O"},
+  {0x2C7E, U"S"}, {0x2C7F, U"Z"}, {0xA730, U"F"}, {0xA731, U"S"},
+  {0xA732, U"AA"}, {0xA733, U"AA"}, {0xA734, U"AO"}, {0xA735, U"AO"},
+  {0xA736, U"AU"}, {0xA737, U"AU"}, {0xA738, U"AV"}, {0xA739, U"AV"},
+  {0xA73A, U"AV"}, {0xA73B, U"AV"}, {0xA73C, U"AY"}, {0xA73D, U"AY"},
+  {0xA740, U"K"}, {0xA741, U"K"}, {0xA742, U"K"}, {0xA743, U"K"},
+  {0xA744, U"K"}, {0xA745, U"K"}, {0xA746, U"L"}, {0xA747, U"L"},
+  {0xA748, U"L"}, {0xA749, U"L"}, {0xA74A, U"O"}, {0xA74B, U"O"},
+  {0xA74C, U"O"}, {0xA74D, U"O"}, {0xA74E, U"OO"}, {0xA74F, U"OO"},
+  {0xA750, U"P"}, {0xA751, U"P"}, {0xA752, U"P"}, {0xA753, U"P"},
+  {0xA754, U"P"}, {0xA755, U"P"}, {0xA756, U"Q"}, {0xA757, U"Q"},
+  {0xA758, U"Q"}, {0xA759, U"Q"}, {0xA75E, U"V"}, {0xA75F, U"V"},
+  {0xA760, U"VY"}, {0xA761, U"VY"}, {0xA764, U"TH"}, {0xA765, U"TH"},
+  {0xA766, U"TH"}, {0xA767, U"TH"}, {0xA771, U"D"}, {0xA772, U"L"},
+  {0xA773, U"M"}, {0xA774, U"N"}, {0xA775, U"R"}, {0xA776, U"R"},
+  {0xA777, U"T"}, {0xA779, U"D"}, {0xA77A, U"D"}, {0xA77B, U"F"},
+  {0xA77C, U"F"}, {0xA786, U"T"}, {0xA787, U"T"}, {0xA790, U"N"},
+  {0xA791, U"N"}, {0xA792, U"C"}, {0xA793, U"C"}, {0xA7A0, U"G"},
+  {0xA7A1, U"G"}, {0xA7A2, U"K"}, {0xA7A3, U"K"}, {0xA7A4, U"N"},
+  {0xA7A5, U"N"}, {0xA7A6, U"R"}, {0xA7A7, U"R"}, {0xA7A8, U"S"},
+  {0xA7A9, U"S"}, {0xA7AA, U"H"}, {0xFB00, U"FF"}, {0xFB01, U"FI"},
+  {0xFB02, U"FL"}, {0xFB03, U"FFI"}, {0xFB04, U"FFL"}, {0xFB05, U"ST"},
+  {0xFB06, U"ST"}, {0xFF21, U"A"}, {0xFF22, U"B"}, {0xFF23, U"C"},
+  {0xFF24, U"D"}, {0xFF25, U"E"}, {0xFF26, U"F"}, {0xFF27, U"G"},
+  {0xFF28, U"H"}, {0xFF29, U"I"}, {0xFF2A, U"J"}, {0xFF2B, U"K"},
+  {0xFF2C, U"L"}, {0xFF2D, U"M"}, {0xFF2E, U"N"}, {0xFF2F, U"O"},
+  {0xFF30, U"P"}, {0xFF31, U"Q"}, {0xFF32, U"R"}, {0xFF33, U"S"},
+  {0xFF34, U"T"}, {0xFF35, U"U"}, {0xFF36, U"V"}, {0xFF37, U"W"},
+  {0xFF38, U"X"}, {0xFF39, U"Y"}, {0xFF3A, U"Z"}, {0xFF41, U"A"},
+  {0xFF42, U"B"}, {0xFF43, U"C"}, {0xFF44, U"D"}, {0xFF45, U"E"},
+  {0xFF46, U"F"}, {0xFF47, U"G"}, {0xFF48, U"H"}, {0xFF49, U"I"},
+  {0xFF4A, U"J"}, {0xFF4B, U"K"}, {0xFF4C, U"L"}, {0xFF4D, U"M"},
+  {0xFF4E, U"N"}, {0xFF4F, U"O"}, {0xFF50, U"P"}, {0xFF51, U"Q"},
+  {0xFF52, U"R"}, {0xFF53, U"S"}, {0xFF54, U"T"}, {0xFF55, U"U"},
+  {0xFF56, U"V"}, {0xFF57, U"W"}, {0xFF58, U"X"}, {0xFF59, U"Y"},
+  {0xFF5A, U"Z"},
+};
+
+// simple upper case mappings of the letters of the Basic Multilingual Plane
+// outside the Latin tables above, as toupper() applies them in
+// name_standardize() (e.g. Greek, Armenian, Cyrillic beyond U+045F): runs of
+// letters first to last, or every other letter from first if `alternate`,
+// mapped to the letter `delta` away. Generated from the Unicode 14 case
+// mappings, leaving out the Georgian letters, which glibc does not upper-case
+struct case_run {
+  char32_t first, last;
+  int delta;
+  bool alternate;
+};
+
+constexpr case_run upper_case_runs[] = {
+  {0x0371, 0x0373, -1, true}, {0x0377, 0x0377, -1, false}, {0x037B, 0x037D, 130, false},
+  {0x03AC, 0x03AC, -38, false}, {0x03AD, 0x03AF, -37, false}, {0x03B1, 0x03C1, -32, false},
+  {0x03C2, 0x03C2, -31, false}, {0x03C3, 0x03CB, -32, false}, {0x03CC, 0x03CC, -64, false},
+  {0x03CD, 0x03CE, -63, false}, {0x03D0, 0x03D0, -62, false}, {0x03D1, 0x03D1, -57, false},
+  {0x03D5, 0x03D5, -47, false}, {0x03D6, 0x03D6, -54, false}, {0x03D7, 0x03D7, -8, false},
+  {0x03D9, 0x03EF, -1, true}, {0x03F0, 0x03F0, -86, false}, {0x03F1, 0x03F1, -80, false},
+  {0x03F2, 0x03F2, 7, false}, {0x03F3, 0x03F3, -116, false}, {0x03F5, 0x03F5, -96, false},
+  {0x03F8, 0x03F8, -1, false}, {0x03FB, 0x03FB, -1, false}, {0x0430, 0x044F, -32, false},
+  {0x0450, 0x045F, -80, false}, {0x0461, 0x0481, -1, true}, {0x048B, 0x04BF, -1, true},
+  {0x04C2, 0x04CE, -1, true}, {0x04CF, 0x04CF, -15, false}, {0x04D1, 0x052F, -1, true},
+  {0x0561, 0x0586, -48, false}, {0x13F8, 0x13FD, -8, false}, {0x1C80, 0x1C80, -6254, false},
+  {0x1C81, 0x1C81, -6253, false}, {0x1C82, 0x1C82, -6244, false}, {0x1C83, 0x1C84, -6242, false},
+  {0x1C85, 0x1C85, -6243, false}, {0x1C86, 0x1C86, -6236, false}, {0x1C87, 0x1C87, -6181, false},
+  {0x1C88, 0x1C88, 35266, false}, {0x1D79, 0x1D79, 35332, false}, {0x1D7D, 0x1D7D, 3814, false},
+  {0x1D8E, 0x1D8E, 35384, false}, {0x1F00, 0x1F07, 8, false}, {0x1F10, 0x1F15, 8, false},
+  {0x1F20, 0x1F27, 8, false}, {0x1F30, 0x1F37, 8, false}, {0x1F40, 0x1F45, 8, false},
+  {0x1F51, 0x1F57, 8, true}, {0x1F60, 0x1F67, 8, false}, {0x1F70, 0x1F71, 74, false},
+  {0x1F72, 0x1F75, 86, false}, {0x1F76, 0x1F77, 100, false}, {0x1F78, 0x1F79, 128, false},
+  {0x1F7A, 0x1F7B, 112, false}, {0x1F7C, 0x1F7D, 126, false}, {0x1FB0, 0x1FB1, 8, false},
+  {0x1FBE, 0x1FBE, -7205, false}, {0x1FD0, 0x1FD1, 8, false}, {0x1FE0, 0x1FE1, 8, false},
+  {0x1FE5, 0x1FE5, 7, false}, {0x214E, 0x214E, -28, false}, {0x2170, 0x217F, -16, false},
+  {0x2184, 0x2184, -1, false}, {0x24D0, 0x24E9, -26, false}, {0x2C30, 0x2C5F, -48, false},
+  {0x2C61, 0x2C61, -1, false}, {0x2C65, 0x2C65, -10795, false}, {0x2C66, 0x2C66, -10792, false},
+  {0x2C68, 0x2C6C, -1, true}, {0x2C73, 0x2C73, -1, false}, {0x2C76, 0x2C76, -1, false},
+  {0x2C81, 0x2CE3, -1, true}, {0x2CEC, 0x2CEE, -1, true}, {0x2CF3, 0x2CF3, -1, false},
+  {0x2D00, 0x2D25, -7264, false}, {0x2D27, 0x2D27, -7264, false}, {0x2D2D, 0x2D2D, -7264, false},
+  {0xA641, 0xA66D, -1, true}, {0xA681, 0xA69B, -1, true}, {0xA723, 0xA72F, -1, true},
+  {0xA733, 0xA76F, -1, true}, {0xA77A, 0xA77C, -1, true}, {0xA77F, 0xA787, -1, true},
+  {0xA78C, 0xA78C, -1, false}, {0xA791, 0xA793, -1, true}, {0xA794, 0xA794, 48, false},
+  {0xA797, 0xA7A9, -1, true}, {0xA7B5, 0xA7C3, -1, true}, {0xA7C8, 0xA7CA, -1, true},
+  {0xA7D1, 0xA7D1, -1, false}, {0xA7D7, 0xA7D9, -1, true}, {0xA7F6, 0xA7F6, -1, false},
+  {0xAB53, 0xAB53, -928, false}, {0xAB70, 0xABBF, -38864, false}, {0xFF41, 0xFF5A, -32, false},
+};
+
+// upper case of `c` by upper_case_runs, or `c` itself
+inline char32_t simple_upper(char32_t c) {
+  const case_run* end = upper_case_runs + sizeof(upper_case_runs) / sizeof(upper_case_runs[0]);
+  const case_run* r = std::upper_bound(upper_case_runs, end, c,
+                                       [](char32_t x, const case_run& run) { return x < run.first; });
+  if (r == upper_case_runs) return c;
+  --r;
+  if (c > r->last || (r->alternate && (c - r->first) % 2 != 0)) return c;
+  return static_cast<char32_t>(static_cast<int>(c) + r->delta);
+}
+
+// append to `out` the upper case ASCII transliteration of `c`, a letter of
+// the tables above, as given by name_standardize(). Returns false for other
+// characters
+inline bool latin_ascii_upper(char32_t c, token_t& out) {
+  const char32_t* t;
+  if (c >= 0xC0 && c <= 0x17F) {
+    for (const char* a = latin_ascii[c - 0xC0]; *a; ++a) out.push_back(static_cast<char32_t>(*a));
+    return true;
+  } else if (c >= 0x180 && c <= 0x2AF) {
+    t = latin_extended_b[c - 0x180];
+  } else if (c >= 0x1E00 && c <= 0x1EFF) {
+    t = latin_extended_additional[c - 0x1E00];
+  } else {
+    const latin_ascii_entry* end =
+      latin_ascii_other + sizeof(latin_ascii_other) / sizeof(latin_ascii_other[0]);
+    const latin_ascii_entry* e = std::lower_bound(
+      latin_ascii_other, end, c, [](const latin_ascii_entry& entry, char32_t x) { return entry.c < x; });
+    if (e == end || e->c != c) return false;
+    t = e->ascii;
+  }
+  for (; *t; ++t) out.push_back(*t);
+  return true;
+}
+
+inline bool is_latin_letter(char32_t c) {
+  return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') ||
+    (c >= 0xC0 && c <= 0x2AF && c != 0xD7 && c != 0xF7) || (c >= 0x1E00 && c <= 0x1EFF);
+}
+
+// native equivalent of name_standardize() followed by tokenization with the
+// default token_split: letters are upper-cased and stripped of diacritics,
+// and names are split into tokens at each run of spaces, punctuation and
+// symbols. Transliteration covers the Latin letters of the Basic Multilingual
+// Plane (see latin_ascii_upper()), dropping the combining diacritical marks
+// that follow them, and the Cyrillic, Arabic and Ethiopic scripts (see
+// transliterate()); other letters are upper-cased as by toupper() (see
+// simple_upper()). Separators are those of is_name_separator(), so symbols
+// beyond Latin-1 that [[:punct:]] matches in R may be kept in tokens here.
+// Tokens are appended to `out` (which the caller passes to
+// name_tokens::add())
+inline void standardize_name(const char* s, std::size_t n, std::vector<token_t>& out) {
+  const token_t x = utf8_decode(s, n);
+  token_t cur, t;
+  bool arabic_word = false;
+  for (char32_t c : x) {
+    const bool word_start = !arabic_word;
+    if (is_arabic_letter(c)) arabic_word = true;
+    else if (!(c >= 0x0640 && c <= 0x065F) && c != 0x0670) arabic_word = false;
+
+    if (is_name_separator(c)) {
+      if (!cur.empty()) out.push_back(std::move(cur));
+      cur.clear();
+    } else if (c >= 'a' && c <= 'z') {
+      cur.push_back(c - ('a' - 'A'));
+    } else if (c >= 0x0300 && c <= 0x036F && !cur.empty() && is_latin_letter(cur.back())) {
+      // combining diacritical mark of a Latin letter, dropped
+    } else {
+      t.clear();
+      if (!latin_ascii_upper(c, t) && !transliterate(c, word_start, t)) t.push_back(simple_upper(c));
+      for (char32_t d : t) {
+        if (!is_name_separator(d)) {
+          cur.push_back(d);
+        } else if (!cur.empty()) {
+          out.push_back(std::move(cur));
+          cur.clear();
+        }
+      }
+    }
+  }
+  if (!cur.empty()) out.push_back(std::move(cur));
+}
+
+// transliterate the Cyrillic, Arabic and Ethiopic letters of a UTF-8 string
+// as standardize_name() does, appending the result to `out` in UTF-8. Other
+// characters are copied unchanged. Returns whether any were transliterated
+inline bool transliterate_utf8(const char* s, std::size_t n, std::string& out) {
+  const token_t x = utf8_decode(s, n);
+  token_t y;
+  y.reserve(x.size());
+  bool arabic_word = false, changed = false;
+  for (char32_t c : x) {
+    const bool word_start = !arabic_word;
+    if (is_arabic_letter(c)) arabic_word = true;
+    else if (!(c >= 0x0640 && c <= 0x065F) && c != 0x0670) arabic_word = false;
+    if (transliterate(c, word_start, y)) changed = true;
+    else y.push_back(c);
+  }
+  out += utf8_encode(y);
+  return changed;
+}
+
+// standardize and tokenize a name as read_names() would the tokens of
+// name_standardize() output, keeping tokens of at least nchar_min characters.
+// The tokens are stored in `arena`
+inline name_tokens standardize_tokens(const char* s, std::size_t n, int nchar_min,
+                                      std::vector<token_t>& work, token_arena& arena) {
+  work.clear();
+  standardize_name(s, n, work);
+  name_tokens out;
+  for (const token_t& t : work) {
+    if (static_cast<int>(t.size()) >= nchar_min) out.add(arena.store(t.data(), t.size()), nchar_min);
+  }
+  out.finalize();
+  return out;
+}
+
+} // namespace nmatch
+
+#endif
@@ -0,0 +1,416 @@
+#ifndef NMATCH_TOKENS_H
+#define NMATCH_TOKENS_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace nmatch {
+
+typedef std::u32string token_t;
+
+// decode a UTF-8 string into codepoints written to `out`, which must have
+// room for n codepoints, returning their number. Malformed sequences are
+// passed through byte-by-byte rather than rejected, mirroring how stringdist
+// treats invalid input
+inline std::size_t utf8_decode(const char* s, std::size_t n, char32_t* out) {
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(s);
+  std::size_t i = 0, m = 0;
+  while (i < n) {
+    unsigned char c = p[i];
+    char32_t cp;
+    std::size_t len;
+    if (c < 0x80) {
+      cp = c; len = 1;
+    } else if ((c & 0xE0) == 0xC0) {
+      cp = c & 0x1F; len = 2;
+    } else if ((c & 0xF0) == 0xE0) {
+      cp = c & 0x0F; len = 3;
+    } else if ((c & 0xF8) == 0xF0) {
+      cp = c & 0x07; len = 4;
+    } else {
+      cp = c; len = 1;
+    }
+    if (len > 1) {
+      if (i + len > n) {
+        cp = c; len = 1;
+      } else {
+        for (std::size_t k = 1; k < len; ++k) {
+          if ((p[i + k] & 0xC0) != 0x80) { cp = c; len = 1; break; }
+          cp = (cp << 6) | (p[i + k] & 0x3F);
+        }
+      }
+    }
+    out[m++] = cp;
+    i += len;
+  }
+  return m;
+}
+
+inline token_t utf8_decode(const char* s, std::size_t n) {
+  token_t out(n, 0);
+  out.resize(utf8_decode(s, n, &out[0]));
+  return out;
+}
+
+// codepoints of a token held in storage owned elsewhere: a token_arena, or a
+// token_t that must outlive the view
+class token_view {
+public:
+  token_view() : p_(nullptr), n_(0) {}
+  token_view(const char32_t* p, std::size_t n) : p_(p), n_(n) {}
+  token_view(const token_t& t) : p_(t.data()), n_(t.size()) {}
+
+  const char32_t* data() const { return p_; }
+  std::size_t size() const { return n_; }
+  bool empty() const { return n_ == 0; }
+  char32_t operator[](std::size_t i) const { return p_[i]; }
+  const char32_t* begin() const { return p_; }
+  const char32_t* end() const { return p_ + n_; }
+
+  token_t str() const { return token_t(p_, n_); }
+
+  // lexicographic order of codepoints, as token_t::compare()
+  int compare(token_view other) const {
+    const std::size_t n = n_ < other.n_ ? n_ : other.n_;
+    for (std::size_t i = 0; i < n; ++i) {
+      if (p_[i] != other.p_[i]) return p_[i] < other.p_[i] ? -1 : 1;
+    }
+    return n_ == other.n_ ? 0 : (n_ < other.n_ ? -1 : 1);
+  }
+
+private:
+  const char32_t* p_;
+  std::size_t n_;
+};
+
+inline bool operator==(token_view a, token_view b) {
+  return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin());
+}
+
+inline bool operator!=(token_view a, token_view b) { return !(a == b); }
+
+// encode codepoints as UTF-8
+inline std::string utf8_encode(token_view x) {
+  std::string out;
+  out.reserve(x.size());
+  for (char32_t cp : x) {
+    if (cp < 0x80) {
+      out.push_back(static_cast<char>(cp));
+    } else if (cp < 0x800) {
+      out.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+      out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    } else if (cp < 0x10000) {
+      out.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+      out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+      out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    } else {
+      out.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+      out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+      out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+      out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+    }
+  }
+  return out;
+}
+
+// narrowest code unit holding every codepoint of a token, in bytes: 1 if all
+// are ASCII, 2 if all are in the Basic Multilingual Plane, 4 otherwise
+inline int char_width(token_view t) {
+  char32_t hi = 0;
+  for (char32_t c : t) hi |= c;
+  return hi < 0x80 ? 1 : (hi < 0x10000 ? 2 : 4);
+}
+
+// storage for the codepoints of the tokens of a set of names. Tokens are
+// stored back to back in blocks that are never moved, so views into the
+// arena remain valid until it is cleared or destroyed, and tokenizing a
+// batch of names costs a single allocation when the arena is reserved for
+// it, rather than one per token
+class token_arena {
+public:
+  explicit token_arena(std::size_t block_size = 4096) : block_size_(block_size) {}
+
+  token_arena(const token_arena&) = delete;
+  token_arena& operator=(const token_arena&) = delete;
+  token_arena(token_arena&&) = default;
+  token_arena& operator=(token_arena&&) = default;
+
+  // make room for n more codepoints in the current block
+  void reserve(std::size_t n) {
+    if (blocks_.empty() || used_ + n > blocks_.back().size) add_block(n);
+  }
+
+  token_view store(const char32_t* p, std::size_t n) {
+    char32_t* dst = allocate(n);
+    std::copy(p, p + n, dst);
+    return token_view(dst, n);
+  }
+
+  // store the codepoints of a UTF-8 string (see utf8_decode())
+  token_view store_utf8(const char* s, std::size_t n) {
+    char32_t* dst = allocate(n);
+    const std::size_t m = utf8_decode(s, n, dst);
+    used_ -= n - m;
+    return token_view(dst, m);
+  }
+
+  // give back the space of `t`, if it was the last token stored
+  void pop(token_view t) {
+    if (!blocks_.empty() && t.data() + t.size() == blocks_.back().data.get() + used_) {
+      used_ -= t.size();
+    }
+  }
+
+  // forget all tokens, keeping the storage for reuse (in a single block)
+  void clear() {
+    if (blocks_.size() > 1) {
+      std::size_t n = 0;
+      for (const block& b : blocks_) n += b.size;
+      blocks_.clear();
+      add_block(n);
+    }
+    used_ = 0;
+  }
+
+  std::size_t n_blocks() const { return blocks_.size(); }
+
+  std::size_t capacity_bytes() const {
+    std::size_t n = 0;
+    for (const block& b : blocks_) n += b.size * sizeof(char32_t);
+    return n;
+  }
+
+private:
+  struct block {
+    std::unique_ptr<char32_t[]> data;
+    std::size_t size;
+  };
+
+  char32_t* allocate(std::size_t n) {
+    reserve(n);
+    char32_t* out = blocks_.back().data.get() + used_;
+    used_ += n;
+    return out;
+  }
+
+  void add_block(std::size_t n) {
+    const std::size_t size = n > block_size_ ? n : block_size_;
+    blocks_.push_back(block{std::unique_ptr<char32_t[]>(new char32_t[size]), size});
+    used_ = 0;
+  }
+
+  std::size_t block_size_;
+  std::vector<block> blocks_;
+  std::size_t used_ = 0; // codepoints used in the last block
+};
+
+// tokens of a single name, deduplicated in order of first occurrence (the R
+// implementation indexes tokens with as.factor(), so repeated tokens count
+// once towards k_x/k_y). Tokens are views, normally into a token_arena
+// holding the tokens of a whole batch of names, which must outlive the name
+struct name_tokens {
+  std::vector<token_view> tokens;
+
+  // hash of the (sorted) token set, set by finalize(). Names with the same
+  // set of tokens, whatever their order, have the same signature
+  std::uint64_t signature = 0;
+
+  // single-letter initials kept apart from the tokens (see add_initial()),
+  // as a set with bit c for letter 'A' + c
+  std::uint32_t initials = 0;
+
+  // first letters A-Z of the tokens, in the same layout as initials, set by
+  // finalize()
+  std::uint32_t first_letters = 0;
+
+  // bytes per character needed to hold every codepoint of the tokens (see
+  // char_width()), set by finalize() so that kernels can be chosen once per
+  // name rather than per comparison
+  std::uint8_t char_width = 1;
+
+  // the tokens of names of char_width 1 again as bytes, back to back, set by
+  // finalize() so that the scalar kernels compare 8-bit code units (see
+  // units()); empty for wider names
+  std::string narrow;
+
+  int k() const { return static_cast<int>(tokens.size()); }
+
+  int n_initials() const { return popcount(initials); }
+
+  // names that were NA or have no token of at least nchar_min characters
+  // (nor any initial) have no valid match summary
+  bool valid() const { return !tokens.empty() || initials != 0; }
+
+  // add a token unless shorter than nchar_min or already present, returning
+  // whether it was added
+  bool add(token_view token, int nchar_min) {
+    if (static_cast<int>(token.size()) < nchar_min) return false;
+    for (token_view t : tokens) if (t == token) return false;
+    tokens.push_back(token);
+    return true;
+  }
+
+  // a temporary token would leave a dangling view
+  bool add(token_t&& token, int nchar_min) = delete;
+
+  // keep a single letter as an initial rather than a token. Returns false
+  // (leaving the name unchanged) if `token` is not a single letter A-Z
+  bool add_initial(token_view token) {
+    if (token.size() != 1) return false;
+    const int c = letter_index(token[0]);
+    if (c < 0) return false;
+    initials |= std::uint32_t(1) << c;
+    return true;
+  }
+
+  // names of up to this many tokens have their token hashes sorted on the
+  // stack by finalize(); longer ones (rare) in a temporary heap buffer
+  static constexpr std::size_t finalize_inline_max = 16;
+
+  // compute the signature once all tokens are added
+  void finalize() {
+    std::uint64_t inline_h[finalize_inline_max];
+    std::vector<std::uint64_t> heap_h;
+    std::uint64_t* h = inline_h;
+    if (tokens.size() > finalize_inline_max) {
+      heap_h.resize(tokens.size());
+      h = heap_h.data();
+    }
+    for (std::size_t i = 0; i < tokens.size(); ++i) h[i] = token_hash(tokens[i]);
+    std::sort(h, h + tokens.size());
+    std::uint64_t sig = 0xcbf29ce484222325ULL;
+    for (std::size_t i = 0; i < tokens.size(); ++i) sig = mix(sig ^ h[i]);
+    signature = sig;
+
+    char_width = 1;
+    for (token_view t : tokens) {
+      const int w = nmatch::char_width(t);
+      if (w > char_width) char_width = static_cast<std::uint8_t>(w);
+    }
+    narrow.clear();
+    if (char_width == 1) {
+      std::size_t n = 0;
+      for (token_view t : tokens) n += t.size();
+      narrow.reserve(n);
+      for (token_view t : tokens) for (char32_t c : t) narrow.push_back(static_cast<char>(c));
+    }
+
+    first_letters = 0;
+    for (token_view t : tokens) {
+      const int c = letter_index(t[0]);
+      if (c >= 0) first_letters |= std::uint32_t(1) << c;
+    }
+  }
+
+  // token i as code units of type C, given the total size `offset` of the
+  // tokens before it: the codepoints for char32_t, or the bytes of `narrow`
+  // for unsigned char (names of char_width 1 only)
+  template <typename C>
+  const C* units(int i, std::size_t offset) const;
+
+  // whether two names have the same token set; the signature comparison
+  // rejects nearly all differing names before tokens are compared
+  bool same_tokens(const name_tokens& other) const {
+    if (signature != other.signature || tokens.size() != other.tokens.size() ||
+        initials != other.initials) {
+      return false;
+    }
+    for (token_view t : tokens) {
+      if (std::find(other.tokens.begin(), other.tokens.end(), t) == other.tokens.end()) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // 0-25 for letters A-Z (either case), -1 otherwise
+  static int letter_index(char32_t c) {
+    if (c >= 'A' && c <= 'Z') return static_cast<int>(c - 'A');
+    if (c >= 'a' && c <= 'z') return static_cast<int>(c - 'a');
+    return -1;
+  }
+
+  static int popcount(std::uint32_t x) {
+    int n = 0;
+    for (; x; x &= x - 1) ++n;
+    return n;
+  }
+
+  // FNV-1a over codepoints
+  static std::uint64_t token_hash(token_view t) {
+    std::uint64_t h = 0xcbf29ce484222325ULL;
+    for (char32_t c : t) {
+      h ^= static_cast<std::uint64_t>(c);
+      h *= 0x100000001b3ULL;
+    }
+    return mix(h);
+  }
+
+  // splitmix64 finalizer
+  static std::uint64_t mix(std::uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+  }
+};
+
+template <>
+inline const char32_t* name_tokens::units<char32_t>(int i, std::size_t) const {
+  return tokens[i].data();
+}
+
+template <>
+inline const unsigned char* name_tokens::units<unsigned char>(int, std::size_t offset) const {
+  return reinterpret_cast<const unsigned char*>(narrow.data()) + offset;
+}
+
+// names x[0], x[1], ... of a block of pairs: either names stored
+// contiguously, or with step 0 a single name repeated for every pair (to
+// compare one name against many without copying it)
+struct name_seq {
+  const name_tokens* p;
+  std::size_t step;
+
+  name_seq(const name_tokens* p, std::size_t step = 1) : p(p), step(step) {}
+
+  const name_tokens& operator[](std::size_t i) const { return p[i * step]; }
+
+  bool repeated() const { return step == 0; }
+};
+
+// names of the pairs from `begin` on, with a single name broadcast to all
+// pairs
+inline name_seq name_block(const std::vector<name_tokens>& x, std::size_t begin) {
+  return x.size() == 1 ? name_seq(x.data(), 0) : name_seq(x.data() + begin);
+}
+
+// bytes of heap storage held by a vector of tokenized names, not counting
+// the arena holding their codepoints
+inline std::size_t storage_bytes(const std::vector<name_tokens>& x) {
+  std::size_t out = x.capacity() * sizeof(name_tokens);
+  for (const name_tokens& n : x) out += n.tokens.capacity() * sizeof(token_view);
+  return out;
+}
+
+// number of heap allocations made for a vector of tokenized names, not
+// counting the arena holding their codepoints: those held by the names, and
+// the temporary buffer finalize() allocates for names of many tokens
+inline std::size_t storage_allocs(const std::vector<name_tokens>& x) {
+  std::size_t out = x.capacity() > 0;
+  for (const name_tokens& n : x) {
+    out += n.tokens.capacity() > 0;
+    out += n.tokens.size() > name_tokens::finalize_inline_max;
+  }
+  return out;
+}
+
+} // namespace nmatch
+
+#endif
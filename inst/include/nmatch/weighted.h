@@ -0,0 +1,152 @@
+#ifndef NMATCH_WEIGHTED_H
+#define NMATCH_WEIGHTED_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace nmatch {
+
+// costs for the weighted edit distance, over an alphabet of the letters A-Z
+// (case-insensitive) plus a class 0 for every other character. Tables are
+// flat n x n arrays indexed by [index(c1) * n + index(c2)]
+struct edit_costs {
+  static const int n = 27;
+
+  // cost of substituting c2 for c1, for c1 != c2 (1 for class 0)
+  double sub[n * n];
+  // letter that the digraph c1 c2 may stand for (e.g. PH for F), 0 if none
+  std::uint8_t digraph[n * n];
+  // cost of reading the digraph c1 c2 as its letter
+  double digraph_cost[n * n];
+  // cost of deleting or inserting the second of a doubled letter
+  double double_letter = 1.0;
+  // smallest cost of an operation moving off the diagonal of the DP matrix,
+  // set by finalize()
+  double min_shift = 1.0;
+
+  edit_costs() {
+    std::fill(sub, sub + n * n, 1.0);
+    std::fill(digraph, digraph + n * n, std::uint8_t(0));
+    std::fill(digraph_cost, digraph_cost + n * n, 1.0);
+  }
+
+  static int index(char32_t c) {
+    if (c >= 'A' && c <= 'Z') return static_cast<int>(c - 'A') + 1;
+    if (c >= 'a' && c <= 'z') return static_cast<int>(c - 'a') + 1;
+    return 0;
+  }
+
+  void finalize() {
+    min_shift = std::min(1.0, double_letter);
+    for (int k = 0; k < n * n; ++k) {
+      if (digraph[k]) min_shift = std::min(min_shift, digraph_cost[k]);
+    }
+  }
+};
+
+// optimal string alignment distance with weighted operations: deletion,
+// insertion and transposition cost 1 as in osa_dist(), but
+// - substitutions cost sub[c1, c2]
+// - a digraph in either token may be read as its letter (e.g. PH as F, DJ as
+//   J, OU as U) for digraph_cost, plus the substitution cost of that letter
+// - deleting or inserting the second of a doubled letter costs double_letter
+// Costs must be positive for operations that move off the diagonal, so with
+// cutoff >= 0 only the band |i - j| <= cutoff / min_shift of the DP matrix is
+// computed, returning cutoff + 1 once the distance must exceed the cutoff
+// (as osa_dist_bounded()). With cutoff < 0 the full distance is computed
+template <typename C>
+double weighted_dist(const C* a, std::size_t na, const C* b, std::size_t nb,
+                     const edit_costs& costs, double cutoff,
+                     std::vector<double>& work, std::vector<int>& iwork) {
+  const bool bounded = cutoff >= 0;
+  const double cap = bounded ? cutoff + 1.0 : HUGE_VAL;
+  const std::size_t diff = na > nb ? na - nb : nb - na;
+  if (bounded && diff * costs.min_shift > cutoff) return cap;
+
+  const std::size_t band = bounded
+    ? static_cast<std::size_t>(std::min(cutoff / costs.min_shift, 1e6))
+    : std::max(na, nb);
+  const int n = edit_costs::n;
+
+  // three rolling DP rows, then per-position costs of b: insertion, and the
+  // letter and cost of a digraph ending at that position
+  work.resize(5 * (nb + 1));
+  double* prev2 = work.data();
+  double* prev = prev2 + nb + 1;
+  double* cur = prev + nb + 1;
+  double* ins = cur + nb + 1;
+  double* dg_b_cost = ins + nb + 1;
+  // class of each character of b, and digraph letters
+  iwork.resize(2 * (nb + 1));
+  int* cb = iwork.data();
+  int* dg_b = cb + nb + 1;
+  for (std::size_t j = 1; j <= nb; ++j) {
+    cb[j] = edit_costs::index(b[j - 1]);
+    ins[j] = j > 1 && b[j - 1] == b[j - 2] ? costs.double_letter : 1.0;
+    const int k = j > 1 ? cb[j - 1] * n + cb[j] : 0;
+    dg_b[j] = j > 1 ? costs.digraph[k] : 0;
+    dg_b_cost[j] = costs.digraph_cost[k];
+  }
+
+  // row 0: insertions of b[0..j)
+  prev[0] = 0.0;
+  for (std::size_t j = 1; j <= nb; ++j) prev[j] = j <= band ? prev[j - 1] + ins[j] : cap;
+  double prev_min = 0.0;
+
+  for (std::size_t i = 1; i <= na; ++i) {
+    const std::size_t lo = i > band ? i - band : 1;
+    const std::size_t hi = i + band < nb ? i + band : nb;
+    const double del = i > 1 && a[i - 1] == a[i - 2] ? costs.double_letter : 1.0;
+
+    // cells bordering the band must read as capped, as in osa_dist_bounded()
+    cur[0] = i <= band ? prev[0] + del : cap;
+    if (lo > 1) cur[lo - 1] = cap;
+    if (hi < nb) cur[hi + 1] = cap;
+
+    const C ai = a[i - 1];
+    const int ca = edit_costs::index(ai);
+    const double* sub_a = costs.sub + ca * n;
+    // digraph a[i-2] a[i-1], read as a letter aligned with b[j-1]
+    const int k_a = i > 1 ? edit_costs::index(a[i - 2]) * n + ca : 0;
+    const int dg_a = i > 1 ? costs.digraph[k_a] : 0;
+    const double* sub_dg_a = costs.sub + dg_a * n;
+    const double dg_a_cost = costs.digraph_cost[k_a];
+    double row_min = lo == 1 ? cur[0] : cap;
+
+    for (std::size_t j = lo; j <= hi; ++j) {
+      double d = std::min(prev[j] + del, cur[j - 1] + ins[j]);
+      d = std::min(d, prev[j - 1] + (ai == b[j - 1] ? 0.0 : sub_a[cb[j]]));
+      if (i > 1 && j > 1 && ai == b[j - 2] && a[i - 2] == b[j - 1]) {
+        d = std::min(d, prev2[j - 2] + 1.0);
+      }
+      if (dg_a) {
+        d = std::min(d, prev2[j - 1] + dg_a_cost + (dg_a == cb[j] ? 0.0 : sub_dg_a[cb[j]]));
+      }
+      // digraph b[j-2] b[j-1] read as a letter aligned with a[i-1]
+      if (dg_b[j]) {
+        d = std::min(d, prev[j - 2] + dg_b_cost[j] + (dg_b[j] == ca ? 0.0 : sub_a[dg_b[j]]));
+      }
+      if (d > cap) d = cap;
+      cur[j] = d;
+      if (d < row_min) row_min = d;
+    }
+
+    // later rows derive from this row and the previous one at no lower cost
+    if (bounded && row_min > cutoff && prev_min > cutoff) return cap;
+
+    prev_min = row_min;
+    double* tmp = prev2;
+    prev2 = prev;
+    prev = cur;
+    cur = tmp;
+  }
+
+  return prev[nb];
+}
+
+} // namespace nmatch
+
+#endif
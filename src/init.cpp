@@ -0,0 +1,51 @@
+#include <R.h>
+#include <Rinternals.h>
+#include <R_ext/Rdynload.h>
+
+// defined in lazy_columns.cpp
+void register_lazy_columns(DllInfo* dll);
+
+extern "C" {
+SEXP client_request(SEXP, SEXP, SEXP);
+SEXP index_append(SEXP, SEXP, SEXP);
+SEXP index_compact(SEXP);
+SEXP index_delete(SEXP, SEXP);
+SEXP index_info(SEXP);
+SEXP index_new();
+SEXP index_search(SEXP, SEXP, SEXP, SEXP);
+SEXP match_pairs(SEXP, SEXP, SEXP, SEXP);
+SEXP name_particles();
+SEXP name_signature(SEXP, SEXP);
+SEXP name_translit(SEXP);
+SEXP server_info(SEXP);
+SEXP server_start(SEXP, SEXP, SEXP, SEXP);
+SEXP server_stop(SEXP);
+SEXP sweep_pairs(SEXP, SEXP, SEXP, SEXP, SEXP);
+SEXP synth_pairs(SEXP, SEXP, SEXP, SEXP, SEXP);
+}
+
+static const R_CallMethodDef call_methods[] = {
+  {"client_request", (DL_FUNC) &client_request, 3},
+  {"index_append", (DL_FUNC) &index_append, 3},
+  {"index_compact", (DL_FUNC) &index_compact, 1},
+  {"index_delete", (DL_FUNC) &index_delete, 2},
+  {"index_info", (DL_FUNC) &index_info, 1},
+  {"index_new", (DL_FUNC) &index_new, 0},
+  {"index_search", (DL_FUNC) &index_search, 4},
+  {"match_pairs", (DL_FUNC) &match_pairs, 4},
+  {"name_particles", (DL_FUNC) &name_particles, 0},
+  {"name_signature", (DL_FUNC) &name_signature, 2},
+  {"name_translit", (DL_FUNC) &name_translit, 1},
+  {"server_info", (DL_FUNC) &server_info, 1},
+  {"server_start", (DL_FUNC) &server_start, 4},
+  {"server_stop", (DL_FUNC) &server_stop, 1},
+  {"sweep_pairs", (DL_FUNC) &sweep_pairs, 5},
+  {"synth_pairs", (DL_FUNC) &synth_pairs, 5},
+  {NULL, NULL, 0}
+};
+
+extern "C" void R_init_nmatch(DllInfo* dll) {
+  R_registerRoutines(dll, NULL, call_methods, NULL, NULL);
+  R_useDynamicSymbols(dll, FALSE);
+  register_lazy_columns(dll);
+}
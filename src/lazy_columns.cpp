@@ -0,0 +1,164 @@
+#include <memory>
+
+#include "lazy_columns.h"
+
+#include <Rversion.h>
+
+#if defined(R_VERSION) && R_VERSION >= R_Version(3, 6, 0)
+#define NMATCH_ALTREP
+#include <R_ext/Altrep.h>
+#endif
+
+namespace {
+
+enum summary_column { COL_K_X = 0, COL_K_Y, COL_K_ALIGN, COL_N_MATCH, COL_DIST_TOTAL, N_COLS };
+
+const char* column_names[] = {"k_x", "k_y", "k_align", "n_match", "dist_total"};
+
+typedef std::shared_ptr<const summary_buffer> buffer_ptr;
+
+void buffer_finalize(SEXP ptr) {
+  delete static_cast<buffer_ptr*>(R_ExternalPtrAddr(ptr));
+  R_ClearExternalPtr(ptr);
+}
+
+int int_value(const summary_record& r, int col) {
+  if (r.k_x < 0) return NA_INTEGER;
+  switch (col) {
+  case COL_K_X: return r.k_x;
+  case COL_K_Y: return r.k_y;
+  case COL_K_ALIGN: return r.k_align;
+  case COL_N_MATCH: return r.n_match;
+  default: return static_cast<int>(r.dist_total);
+  }
+}
+
+double real_value(const summary_record& r) {
+  return r.k_x < 0 ? NA_REAL : r.dist_total;
+}
+
+SEXPTYPE column_type(const summary_buffer& b, int col) {
+  return col == COL_DIST_TOTAL && b.real_dist ? REALSXP : INTSXP;
+}
+
+// ordinary vector of column `col`
+SEXP fill_column(const summary_buffer& b, int col) {
+  const R_xlen_t n = static_cast<R_xlen_t>(b.records.size());
+  SEXP out = PROTECT(Rf_allocVector(column_type(b, col), n));
+  if (TYPEOF(out) == REALSXP) {
+    double* p = REAL(out);
+    for (R_xlen_t i = 0; i < n; ++i) p[i] = real_value(b.records[i]);
+  } else {
+    int* p = INTEGER(out);
+    for (R_xlen_t i = 0; i < n; ++i) p[i] = int_value(b.records[i], col);
+  }
+  UNPROTECT(1);
+  return out;
+}
+
+#ifdef NMATCH_ALTREP
+
+// a lazy column is an ALTREP vector with data1 = list(buffer, column) and
+// data2 the materialized column, or NULL until materialized
+R_altrep_class_t lazy_int_class;
+R_altrep_class_t lazy_real_class;
+
+const summary_buffer& column_buffer(SEXP x) {
+  SEXP ptr = VECTOR_ELT(R_altrep_data1(x), 0);
+  return **static_cast<buffer_ptr*>(R_ExternalPtrAddr(ptr));
+}
+
+int column_id(SEXP x) {
+  return INTEGER(VECTOR_ELT(R_altrep_data1(x), 1))[0];
+}
+
+SEXP materialize(SEXP x) {
+  SEXP data = R_altrep_data2(x);
+  if (data == R_NilValue) {
+    data = PROTECT(fill_column(column_buffer(x), column_id(x)));
+    R_set_altrep_data2(x, data);
+    UNPROTECT(1);
+  }
+  return data;
+}
+
+R_xlen_t lazy_length(SEXP x) {
+  return static_cast<R_xlen_t>(column_buffer(x).records.size());
+}
+
+void* lazy_dataptr(SEXP x, Rboolean writeable) {
+  SEXP data = materialize(x);
+  return TYPEOF(data) == INTSXP ? static_cast<void*>(INTEGER(data)) : static_cast<void*>(REAL(data));
+}
+
+const void* lazy_dataptr_or_null(SEXP x) {
+  SEXP data = R_altrep_data2(x);
+  return data == R_NilValue ? NULL : DATAPTR_RO(data);
+}
+
+int lazy_int_elt(SEXP x, R_xlen_t i) {
+  SEXP data = R_altrep_data2(x);
+  if (data != R_NilValue) return INTEGER(data)[i];
+  return int_value(column_buffer(x).records[i], column_id(x));
+}
+
+double lazy_real_elt(SEXP x, R_xlen_t i) {
+  SEXP data = R_altrep_data2(x);
+  if (data != R_NilValue) return REAL(data)[i];
+  return real_value(column_buffer(x).records[i]);
+}
+
+Rboolean lazy_inspect(SEXP x, int pre, int deep, int pvec, void (*inspect_subtree)(SEXP, int, int, int)) {
+  Rprintf("nmatch lazy column %s (%s)\n", column_names[column_id(x)],
+          R_altrep_data2(x) == R_NilValue ? "not materialized" : "materialized");
+  return TRUE;
+}
+
+#endif
+
+} // namespace
+
+SEXP summary_columns(std::shared_ptr<const summary_buffer> buffer, bool lazy) {
+  SEXP out = PROTECT(Rf_allocVector(VECSXP, N_COLS));
+  Rf_setAttrib(out, R_NamesSymbol, mk_names(column_names, N_COLS));
+
+#ifdef NMATCH_ALTREP
+  if (lazy) {
+    const bool real_dist = buffer->real_dist;
+    SEXP ptr = PROTECT(R_MakeExternalPtr(new buffer_ptr(std::move(buffer)), R_NilValue, R_NilValue));
+    R_RegisterCFinalizerEx(ptr, buffer_finalize, TRUE);
+    for (int col = 0; col < N_COLS; ++col) {
+      SEXP data1 = PROTECT(Rf_allocVector(VECSXP, 2));
+      SET_VECTOR_ELT(data1, 0, ptr);
+      SET_VECTOR_ELT(data1, 1, Rf_ScalarInteger(col));
+      const bool real = col == COL_DIST_TOTAL && real_dist;
+      SET_VECTOR_ELT(out, col, R_new_altrep(real ? lazy_real_class : lazy_int_class, data1, R_NilValue));
+      UNPROTECT(1);
+    }
+    UNPROTECT(2);
+    return out;
+  }
+#endif
+
+  for (int col = 0; col < N_COLS; ++col) SET_VECTOR_ELT(out, col, fill_column(*buffer, col));
+  UNPROTECT(1);
+  return out;
+}
+
+void register_lazy_columns(DllInfo* dll) {
+#ifdef NMATCH_ALTREP
+  lazy_int_class = R_make_altinteger_class("lazy_int", "nmatch", dll);
+  R_set_altrep_Length_method(lazy_int_class, lazy_length);
+  R_set_altrep_Inspect_method(lazy_int_class, lazy_inspect);
+  R_set_altvec_Dataptr_method(lazy_int_class, lazy_dataptr);
+  R_set_altvec_Dataptr_or_null_method(lazy_int_class, lazy_dataptr_or_null);
+  R_set_altinteger_Elt_method(lazy_int_class, lazy_int_elt);
+
+  lazy_real_class = R_make_altreal_class("lazy_real", "nmatch", dll);
+  R_set_altrep_Length_method(lazy_real_class, lazy_length);
+  R_set_altrep_Inspect_method(lazy_real_class, lazy_inspect);
+  R_set_altvec_Dataptr_method(lazy_real_class, lazy_dataptr);
+  R_set_altvec_Dataptr_or_null_method(lazy_real_class, lazy_dataptr_or_null);
+  R_set_altreal_Elt_method(lazy_real_class, lazy_real_elt);
+#endif
+}
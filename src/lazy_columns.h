@@ -0,0 +1,49 @@
+#ifndef NMATCH_LAZY_COLUMNS_H
+#define NMATCH_LAZY_COLUMNS_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "r_utils.h"
+
+#include <R_ext/Rdynload.h>
+
+#include <nmatch/align.h>
+
+// match summary of a pair as kept in a summary_buffer, with k_x < 0 for
+// pairs without a valid summary
+struct summary_record {
+  std::int32_t k_x;
+  std::int32_t k_y;
+  std::int32_t k_align;
+  std::int32_t n_match;
+  double dist_total;
+
+  void set(const nmatch::pair_summary& s) {
+    k_x = s.valid ? s.k_x : -1;
+    k_y = s.k_y;
+    k_align = s.k_align;
+    n_match = s.n_match;
+    dist_total = s.dist_total;
+  }
+};
+
+// match summaries of a call to match_pairs(), one record per pair
+struct summary_buffer {
+  std::vector<summary_record> records;
+  bool real_dist = false; // dist_total as double rather than integer
+};
+
+// list of the summary columns k_x, k_y, k_align, n_match and dist_total of
+// `buffer`. With `lazy` (on R >= 3.6), each column is an ALTREP vector reading
+// its elements from the buffer, and copied out into an ordinary vector only
+// when R asks for a pointer to its data, so columns that are never used are
+// never allocated. The buffer is freed once no column refers to it. Otherwise
+// the columns are ordinary vectors, filled in full
+SEXP summary_columns(std::shared_ptr<const summary_buffer> buffer, bool lazy);
+
+// register the ALTREP classes of the lazy columns, from R_init_nmatch()
+void register_lazy_columns(DllInfo* dll);
+
+#endif
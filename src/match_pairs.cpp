@@ -0,0 +1,338 @@
+#include <climits>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include "lazy_columns.h"
+#include "r_profile.h"
+#include "r_utils.h"
+
+#include <nmatch/engine.h>
+#include <nmatch/explain.h>
+#include <nmatch/frequency.h>
+#include <nmatch/parallel.h>
+
+static SEXP counters_sexp(const nmatch::match_counters& c) {
+  const char* names[] = {
+    "pairs", "exact", "token_comparisons", "dist_cutoffs",
+    "exit_tokens", "exit_matrix", "exit_align", "merges"
+  };
+  const double values[] = {
+    (double) c.pairs, (double) c.exact, (double) c.token_comparisons, (double) c.dist_cutoffs,
+    (double) c.exit_tokens, (double) c.exit_matrix, (double) c.exit_align, (double) c.merges
+  };
+  const int n = sizeof(values) / sizeof(values[0]);
+  SEXP out = PROTECT(Rf_allocVector(REALSXP, n));
+  SEXP nms = PROTECT(Rf_allocVector(STRSXP, n));
+  for (int i = 0; i < n; ++i) {
+    REAL(out)[i] = values[i];
+    SET_STRING_ELT(nms, i, Rf_mkChar(names[i]));
+  }
+  Rf_setAttrib(out, R_NamesSymbol, nms);
+  UNPROTECT(2);
+  return out;
+}
+
+// explanation of the match summaries of pairs x[i], y[i]: the token pairs
+// of pair i are n_aligned[i] entries of the alignment trace of thread
+// src_thread[i], from entry src_entry[i]. Returns a list of
+// - tokens: the distinct tokens and initials of x and y
+// - pair_ptr: offsets, with the token pairs of pair i at positions
+//   pair_ptr[i] + 1 to pair_ptr[i + 1] of token_x, token_y and dist
+// - token_x, token_y: positions in `tokens` of the aligned tokens
+// - dist: distances of the aligned tokens
+static SEXP alignment_sexp(const std::vector<nmatch::name_tokens>& x,
+                           const std::vector<nmatch::name_tokens>& y,
+                           const std::vector<nmatch::alignment_trace>& traces,
+                           const std::vector<int>& src_thread,
+                           const std::vector<std::size_t>& src_entry,
+                           const std::vector<int>& n_aligned) {
+  const R_xlen_t n = static_cast<R_xlen_t>(n_aligned.size());
+  std::size_t total = 0;
+  for (int k : n_aligned) total += k;
+  if (total > static_cast<std::size_t>(INT_MAX)) throw std::length_error("too many aligned tokens to explain");
+
+  nmatch::token_dictionary dict;
+  const nmatch::name_token_ids x_ids(x, dict), y_ids(y, dict);
+
+  const char* names[] = {"tokens", "pair_ptr", "token_x", "token_y", "dist"};
+  SEXP out = PROTECT(Rf_allocVector(VECSXP, 5));
+  Rf_setAttrib(out, R_NamesSymbol, mk_names(names, 5));
+
+  const std::vector<nmatch::token_t>& tokens = dict.tokens();
+  SEXP tokens_sexp = Rf_allocVector(STRSXP, static_cast<R_xlen_t>(tokens.size()));
+  SET_VECTOR_ELT(out, 0, tokens_sexp);
+  for (std::size_t k = 0; k < tokens.size(); ++k) {
+    SET_STRING_ELT(tokens_sexp, k, Rf_mkCharCE(nmatch::utf8_encode(tokens[k]).c_str(), CE_UTF8));
+  }
+
+  SET_VECTOR_ELT(out, 1, Rf_allocVector(INTSXP, n + 1));
+  SET_VECTOR_ELT(out, 2, Rf_allocVector(INTSXP, total));
+  SET_VECTOR_ELT(out, 3, Rf_allocVector(INTSXP, total));
+  SET_VECTOR_ELT(out, 4, Rf_allocVector(REALSXP, total));
+  int* pair_ptr = INTEGER(VECTOR_ELT(out, 1));
+  int* token_x = INTEGER(VECTOR_ELT(out, 2));
+  int* token_y = INTEGER(VECTOR_ELT(out, 3));
+  double* dist = REAL(VECTOR_ELT(out, 4));
+
+  std::size_t k = 0;
+  pair_ptr[0] = 0;
+  for (R_xlen_t i = 0; i < n; ++i) {
+    const nmatch::alignment_trace& trace = traces[src_thread[i]];
+    const std::size_t ix = x.size() == 1 ? 0 : i, iy = y.size() == 1 ? 0 : i;
+    for (std::size_t e = src_entry[i]; e < src_entry[i] + n_aligned[i]; ++e, ++k) {
+      token_x[k] = x_ids(ix, trace.x[e]) + 1;
+      token_y[k] = y_ids(iy, trace.y[e]) + 1;
+      dist[k] = trace.dist[e];
+    }
+    pair_ptr[i + 1] = static_cast<int>(k);
+  }
+
+  UNPROTECT(1);
+  return out;
+}
+
+// concatenation of two named lists
+static SEXP concat_lists(SEXP a, SEXP b) {
+  const R_xlen_t n_a = Rf_xlength(a), n_b = Rf_xlength(b);
+  SEXP out = PROTECT(Rf_allocVector(VECSXP, n_a + n_b));
+  SEXP names = PROTECT(Rf_allocVector(STRSXP, n_a + n_b));
+  SEXP names_a = Rf_getAttrib(a, R_NamesSymbol), names_b = Rf_getAttrib(b, R_NamesSymbol);
+  for (R_xlen_t i = 0; i < n_a; ++i) {
+    SET_VECTOR_ELT(out, i, VECTOR_ELT(a, i));
+    SET_STRING_ELT(names, i, STRING_ELT(names_a, i));
+  }
+  for (R_xlen_t i = 0; i < n_b; ++i) {
+    SET_VECTOR_ELT(out, n_a + i, VECTOR_ELT(b, i));
+    SET_STRING_ELT(names, n_a + i, STRING_ELT(names_b, i));
+  }
+  Rf_setAttrib(out, R_NamesSymbol, names);
+  UNPROTECT(2);
+  return out;
+}
+
+// compare names x[i] and y[i] for each i (or a single name x or y with every
+// name of the other side), with token distances given by
+// params$method (see enum dist_method), and for weighted distances the costs
+// in params$costs. Tokens in params$particles (see read_token_filter()) are
+// dropped from names, and the others replaced by their canonical spelling in
+// params$aliases (see read_aliases()). Single letters are kept as initials if
+// params$initial_cost is not NULL (see align_initials() in engine.h). If
+// `rule` is NULL, returns a list of match summary columns (k_x, k_y,
+// k_align, n_match, dist_total) to be classified in R, with dist_total
+// integer for OSA without initials and double otherwise. Otherwise `rule` is
+// a list(kind, param) describing one of the native classification rules, and
+// each pair is classified as soon as its outcome is known, returning only a
+// logical vector, or if params$full is TRUE, the summary columns preceded by
+// a column is_match classifying each summary. Summary columns are lazy
+// (see lazy_columns.h) if params$lazy is TRUE. If params$explain is TRUE,
+// pairs are summarized whatever `rule`, and the aligned tokens of each pair
+// attached as attribute "alignment" (see alignment_sexp()). If params$idf is
+// TRUE, pairs are summarized whatever `rule`, with two more columns,
+// n_match_idf and score_idf, weighing matching tokens by their inverse
+// document frequency over all names of x and y (see frequency.h), counted
+// exactly unless the names have more than params$idf_exact_max tokens. If
+// params$counters is TRUE, the engine's work counters are attached as
+// attribute "counters", and if params$profile is TRUE, stage timings as
+// attribute "profile" (see r_profile.h). Pairs are compared on
+// params$threads threads, in blocks whose token distances are computed in
+// SIMD batches unless params$simd is FALSE
+extern "C" SEXP match_pairs(SEXP x_token, SEXP y_token, SEXP params, SEXP rule) {
+  const R_xlen_t n = n_pairs(x_token, y_token);
+
+  const int nchar_min = list_int(params, "nchar_min", 2);
+  const bool counters = list_int(params, "counters", 0) == 1;
+  const int n_threads = list_int(params, "threads", 1);
+  const bool profile = list_int(params, "profile", 0) == 1;
+  const bool lazy = list_int(params, "lazy", 0) == 1;
+
+  nmatch::match_params mp;
+  mp.dist_max = list_double(params, "dist_max", 1.0);
+  mp.simd = list_int(params, "simd", 1) == 1;
+  mp.method = static_cast<nmatch::dist_method>(list_int(params, "method", nmatch::DIST_OSA));
+  mp.jw_p = list_double(params, "jw_p", 0.0);
+  nmatch::edit_costs costs;
+  read_costs(list_elt(params, "costs"), costs);
+  mp.costs = &costs;
+  SEXP particles_sexp = list_elt(params, "particles");
+  SEXP aliases_sexp = list_elt(params, "aliases");
+  mp.merge_max = list_int(params, "merge_max", 1);
+  // single letters are kept as initials if params$initial_cost is given
+  const bool initials = list_elt(params, "initial_cost") != R_NilValue;
+  mp.initial_cost = list_double(params, "initial_cost", 0.0);
+  // Jaro-Winkler and weighted distances are fractional, as are the
+  // distances of initials, OSA distances otherwise whole numbers
+  const bool real_dist = mp.method != nmatch::DIST_OSA || initials;
+
+  const bool classify = rule != R_NilValue;
+  const bool explain = list_int(params, "explain", 0) == 1;
+  const bool idf = list_int(params, "idf", 0) == 1;
+  const bool summary = !classify || explain || idf || list_int(params, "full", 0) == 1;
+  // aligned token pairs are traced to be explained or weighed
+  const bool tracing = explain || idf;
+  nmatch::eval_rule er;
+  er.kind = classify ? static_cast<nmatch::rule_kind>(list_int(rule, "kind", 0))
+                     : nmatch::RULE_NONE;
+  er.param = classify ? list_double(rule, "param", 0.0) : 0.0;
+
+  // pairs are classified into is_match as they are compared, and summarized
+  // into a buffer from which the summary columns are built at the end
+  int n_protect = 0;
+  SEXP is_match_sexp = R_NilValue;
+  int* is_match = NULL;
+  if (classify) {
+    is_match_sexp = PROTECT(Rf_allocVector(LGLSXP, n));
+    ++n_protect;
+    is_match = LOGICAL(is_match_sexp);
+  }
+  SEXP out = is_match_sexp;
+
+  // weighted summary columns
+  const char* idf_names[] = {"n_match_idf", "score_idf"};
+  SEXP idf_cols = PROTECT(Rf_allocVector(VECSXP, 2));
+  ++n_protect;
+  Rf_setAttrib(idf_cols, R_NamesSymbol, mk_names(idf_names, 2));
+  SET_VECTOR_ELT(idf_cols, 0, Rf_allocVector(REALSXP, idf ? n : 0));
+  SET_VECTOR_ELT(idf_cols, 1, Rf_allocVector(REALSXP, idf ? n : 0));
+  double* n_match_idf = REAL(VECTOR_ELT(idf_cols, 0));
+  double* score_idf = REAL(VECTOR_ELT(idf_cols, 1));
+
+  std::string err;
+  try {
+    const nmatch::profile_clock::time_point origin = nmatch::profile_clock::now();
+    std::vector<nmatch::match_profile> profiles(profile ? n_threads : 0, nmatch::match_profile(origin));
+
+    nmatch::token_filter particles;
+    read_token_filter(particles_sexp, particles);
+    const nmatch::token_filter* drop = particles.empty() ? nullptr : &particles;
+    nmatch::alias_trie aliases;
+    read_aliases(aliases_sexp, aliases);
+    const nmatch::alias_trie* canon = aliases.empty() ? nullptr : &aliases;
+
+    // the tokens of both sides share a single arena block
+    nmatch::token_arena arena;
+    std::vector<nmatch::name_tokens> x, y;
+    // token frequencies are counted as names are read, then turned into the
+    // weights of the tokens of each name
+    const double idf_exact_max = list_double(params, "idf_exact_max", 4194304.0);
+    nmatch::token_frequencies freq(idf && token_count(x_token) + token_count(y_token) > idf_exact_max);
+    std::unique_ptr<nmatch::name_weights> wx, wy;
+    {
+      nmatch::stage_timer t(profile ? &profiles[0] : nullptr, nmatch::STAGE_PREPARE);
+      arena.reserve(token_bytes(x_token) + token_bytes(y_token));
+      x = read_names(x_token, nchar_min, arena, initials, drop, canon, idf ? &freq : nullptr);
+      y = read_names(y_token, nchar_min, arena, initials, drop, canon, idf ? &freq : nullptr);
+      if (idf) {
+        wx.reset(new nmatch::name_weights(x, freq));
+        wy.reset(new nmatch::name_weights(y, freq));
+      }
+    }
+    if (profile) {
+      profiles[0].alloc_bytes[nmatch::STAGE_PREPARE] +=
+        nmatch::storage_bytes(x) + nmatch::storage_bytes(y) + arena.capacity_bytes() +
+        freq.capacity_bytes();
+      profiles[0].allocs[nmatch::STAGE_PREPARE] +=
+        nmatch::storage_allocs(x) + nmatch::storage_allocs(y) + arena.n_blocks();
+    }
+
+    std::vector<nmatch::matcher> matchers(n_threads, nmatch::matcher(mp));
+    for (int t = 0; profile && t < n_threads; ++t) matchers[t].set_profile(&profiles[t]);
+    // summaries of the current block of each thread, reused across blocks
+    std::vector<std::vector<nmatch::pair_summary>> summaries(summary ? n_threads : 0);
+    std::shared_ptr<summary_buffer> buffer = std::make_shared<summary_buffer>();
+    buffer->real_dist = real_dist;
+    buffer->records.resize(summary ? n : 0);
+    summary_record* records = buffer->records.data();
+
+    // aligned tokens of each thread, and where to find those of each pair
+    std::vector<nmatch::alignment_trace> traces(tracing ? n_threads : 0);
+    std::vector<int> src_thread(explain ? n : 0), n_aligned(explain ? n : 0);
+    std::vector<std::size_t> src_entry(explain ? n : 0);
+    for (int t = 0; tracing && t < n_threads; ++t) matchers[t].set_trace(&traces[t]);
+
+    nmatch::parallel_for(n, n_threads, [&](int thread, std::size_t begin, std::size_t end) {
+      nmatch::matcher& m = matchers[thread];
+      nmatch::block_timer bt(profile ? &profiles[thread] : nullptr, thread, end - begin);
+      const nmatch::name_seq xs = nmatch::name_block(x, begin), ys = nmatch::name_block(y, begin);
+      if (!summary) {
+        m.is_match_block(xs, ys, end - begin, er, is_match + begin);
+        return;
+      }
+      std::vector<nmatch::pair_summary>& s = summaries[thread];
+      s.resize(end - begin);
+      m.summarize_block(xs, ys, end - begin, s.data());
+      for (std::size_t i = begin; i < end; ++i) {
+        if (classify) is_match[i] = er(s[i - begin]);
+        records[i].set(s[i - begin]);
+      }
+      if (!tracing) return;
+      // the block's pairs are the last entries of the thread's trace
+      nmatch::alignment_trace& trace = traces[thread];
+      std::size_t entry = trace.x.size();
+      for (std::size_t i = end; i-- > begin;) {
+        const int k = trace.n_aligned[trace.n_aligned.size() - (end - i)];
+        entry -= k;
+        if (idf && s[i - begin].valid) {
+          const std::size_t ix = x.size() == 1 ? 0 : i, iy = y.size() == 1 ? 0 : i;
+          const nmatch::weighted_summary w =
+            nmatch::weigh_alignment(*wx, ix, *wy, iy, trace, entry, k, mp.dist_max);
+          n_match_idf[i] = w.n_match;
+          score_idf[i] = w.score;
+        } else if (idf) {
+          n_match_idf[i] = score_idf[i] = NA_REAL;
+        }
+        if (!explain) continue;
+        src_thread[i] = thread;
+        src_entry[i] = entry;
+        n_aligned[i] = k;
+      }
+      // pairs only weighed need not be kept
+      if (!explain) trace.clear();
+    });
+
+    if (summary) {
+      out = PROTECT(summary_columns(std::move(buffer), lazy));
+      ++n_protect;
+      if (idf) {
+        out = PROTECT(concat_lists(out, idf_cols));
+        ++n_protect;
+      }
+      if (classify) {
+        const char* is_match_name[] = {"is_match"};
+        SEXP first = PROTECT(Rf_allocVector(VECSXP, 1));
+        SET_VECTOR_ELT(first, 0, is_match_sexp);
+        Rf_setAttrib(first, R_NamesSymbol, mk_names(is_match_name, 1));
+        out = PROTECT(concat_lists(first, out));
+        n_protect += 2;
+      }
+    }
+
+    if (explain) {
+      SEXP alignment = PROTECT(alignment_sexp(x, y, traces, src_thread, src_entry, n_aligned));
+      ++n_protect;
+      Rf_setAttrib(out, Rf_install("alignment"), alignment);
+    }
+
+    if (counters) {
+      nmatch::match_counters total;
+      for (const nmatch::matcher& m : matchers) total += m.counters();
+      SEXP counters_attr = PROTECT(counters_sexp(total));
+      ++n_protect;
+      Rf_setAttrib(out, Rf_install("counters"), counters_attr);
+    }
+
+    if (profile) {
+      for (int t = 1; t < n_threads; ++t) profiles[0] += profiles[t];
+      SEXP profile_attr = PROTECT(profile_sexp(profiles[0]));
+      ++n_protect;
+      Rf_setAttrib(out, Rf_install("profile"), profile_attr);
+    }
+  } catch (const std::exception& e) {
+    err = e.what();
+  }
+
+  UNPROTECT(n_protect);
+  if (!err.empty()) Rf_error("%s", err.c_str());
+  return out;
+}
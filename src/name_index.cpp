@@ -0,0 +1,223 @@
+#include <cmath>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include "r_utils.h"
+
+#include <nmatch/eval.h>
+#include <nmatch/index.h>
+#include <nmatch/parallel.h>
+
+// R handle on a nmatch::name_index: an external pointer to a shared_ptr,
+// deleted with the last reference to it in R. The index itself lives until
+// any server using it (see server.cpp) has stopped as well
+
+static void index_finalize(SEXP ptr) {
+  delete static_cast<std::shared_ptr<nmatch::name_index>*>(R_ExternalPtrAddr(ptr));
+  R_ClearExternalPtr(ptr);
+}
+
+std::shared_ptr<nmatch::name_index> index_shared(SEXP ptr) {
+  if (TYPEOF(ptr) != EXTPTRSXP) Rf_error("not a name index");
+  std::shared_ptr<nmatch::name_index>* index =
+    static_cast<std::shared_ptr<nmatch::name_index>*>(R_ExternalPtrAddr(ptr));
+  // external pointers are reset to NULL when an R session is saved and
+  // restored
+  if (index == NULL) Rf_error("name index is no longer available (it cannot be saved with the R session)");
+  return *index;
+}
+
+static nmatch::name_index* index_get(SEXP ptr) {
+  return index_shared(ptr).get();
+}
+
+extern "C" SEXP index_new() {
+  SEXP ptr = PROTECT(R_MakeExternalPtr(
+    new std::shared_ptr<nmatch::name_index>(std::make_shared<nmatch::name_index>()),
+    R_NilValue, R_NilValue
+  ));
+  R_RegisterCFinalizerEx(ptr, index_finalize, TRUE);
+  UNPROTECT(1);
+  return ptr;
+}
+
+// append tokenized names, returning their (1-based) record ids
+extern "C" SEXP index_append(SEXP ptr, SEXP x_token, SEXP nchar_min) {
+  nmatch::name_index* index = index_get(ptr);
+  const R_xlen_t n = Rf_xlength(x_token);
+  SEXP out = PROTECT(Rf_allocVector(REALSXP, n));
+
+  std::string err;
+  try {
+    // the index copies the tokens into an arena of its own
+    nmatch::token_arena arena;
+    const nmatch::record_id first = index->append(read_names(x_token, Rf_asInteger(nchar_min), arena));
+    for (R_xlen_t i = 0; i < n; ++i) REAL(out)[i] = static_cast<double>(first + i + 1);
+  } catch (const std::exception& e) {
+    err = e.what();
+  }
+
+  UNPROTECT(1);
+  if (!err.empty()) Rf_error("%s", err.c_str());
+  return out;
+}
+
+// tombstone records by (1-based) id, as a single update, returning the
+// number newly deleted
+extern "C" SEXP index_delete(SEXP ptr, SEXP ids) {
+  nmatch::name_index* index = index_get(ptr);
+  const double* id = REAL(ids);
+  const R_xlen_t n = Rf_xlength(ids);
+  std::vector<nmatch::record_id> del(n);
+  for (R_xlen_t i = 0; i < n; ++i) {
+    if (!(id[i] >= 1 && id[i] <= 9e15) || id[i] != std::floor(id[i])) {
+      Rf_error("record id %g is not in the index", id[i]);
+    }
+    del[i] = static_cast<nmatch::record_id>(id[i]) - 1;
+  }
+
+  std::size_t deleted = 0;
+  std::string err;
+  try {
+    deleted = index->remove(del);
+  } catch (const std::out_of_range&) {
+    err = "record ids must be in the index";
+  } catch (const std::exception& e) {
+    err = e.what();
+  }
+  if (!err.empty()) Rf_error("%s", err.c_str());
+  return Rf_ScalarInteger(static_cast<int>(deleted));
+}
+
+extern "C" SEXP index_compact(SEXP ptr) {
+  nmatch::name_index* index = index_get(ptr);
+  std::string err;
+  try {
+    index->compact();
+  } catch (const std::exception& e) {
+    err = e.what();
+  }
+  if (!err.empty()) Rf_error("%s", err.c_str());
+  return R_NilValue;
+}
+
+extern "C" SEXP index_info(SEXP ptr) {
+  const std::shared_ptr<const nmatch::index_snapshot> index = index_get(ptr)->snapshot();
+  const char* names[] = {"records", "deleted", "segments", "tokens"};
+  const double values[] = {
+    (double) index->size(), (double) index->n_deleted(),
+    (double) index->n_segments(), (double) index->n_tokens()
+  };
+  SEXP out = PROTECT(Rf_allocVector(REALSXP, 4));
+  for (int i = 0; i < 4; ++i) REAL(out)[i] = values[i];
+  Rf_setAttrib(out, R_NamesSymbol, mk_names(names, 4));
+  UNPROTECT(1);
+  return out;
+}
+
+namespace {
+
+struct search_hit {
+  nmatch::record_id id;
+  nmatch::pair_summary summary;
+};
+
+} // namespace
+
+// for each tokenized name x[i], find the live records of the index sharing at
+// least one matching token with it, and summarize each such pair as in
+// match_pairs(). If `rule` is not NULL (a list(kind, param) as for
+// match_pairs()), candidates with fewer matching tokens than the rule's
+// n_match threshold are left out, as they cannot match. Returns a list of
+// columns query (1-based position in x), id (1-based record id), k_x, k_y,
+// k_align, n_match and dist_total, ordered by query then id. All names are
+// searched in the same snapshot of the index, unaffected by concurrent
+// updates. params as for match_pairs()
+extern "C" SEXP index_search(SEXP ptr, SEXP x_token, SEXP params, SEXP rule) {
+  const std::size_t n = static_cast<std::size_t>(Rf_xlength(x_token));
+  const int nchar_min = list_int(params, "nchar_min", 2);
+  const int n_threads = list_int(params, "threads", 1);
+
+  nmatch::match_params mp;
+  mp.dist_max = list_double(params, "dist_max", 1.0);
+  mp.method = static_cast<nmatch::dist_method>(list_int(params, "method", nmatch::DIST_OSA));
+  mp.jw_p = list_double(params, "jw_p", 0.0);
+  nmatch::edit_costs costs;
+  read_costs(list_elt(params, "costs"), costs);
+  mp.costs = &costs;
+  const bool real_dist = mp.method != nmatch::DIST_OSA;
+  const int osa_bound = mp.method == nmatch::DIST_OSA && mp.dist_max >= 0
+    ? static_cast<int>(std::floor(std::min(mp.dist_max, 1e6))) : -1;
+  nmatch::eval_rule er;
+  er.kind = rule == R_NilValue ? nmatch::RULE_NONE
+                               : static_cast<nmatch::rule_kind>(list_int(rule, "kind", 0));
+  er.param = rule == R_NilValue ? 0.0 : list_double(rule, "param", 0.0);
+  const bool prune = er.kind != nmatch::RULE_NONE && er.uses_threshold();
+
+  // held until the candidates' names are no longer needed
+  const std::shared_ptr<const nmatch::index_snapshot> index = index_get(ptr)->snapshot();
+  std::vector<std::vector<search_hit>> hits(n);
+  std::string err;
+  try {
+    nmatch::token_arena arena;
+    const std::vector<nmatch::name_tokens> x = read_names(x_token, nchar_min, arena);
+    std::vector<nmatch::matcher> matchers(n_threads, nmatch::matcher(mp));
+
+    nmatch::parallel_for(n, n_threads, [&](int thread, std::size_t begin, std::size_t end) {
+      nmatch::matcher& m = matchers[thread];
+      std::vector<nmatch::index_hit> candidates;
+      nmatch::index_search_work work;
+      for (std::size_t i = begin; i < end; ++i) {
+        if (!x[i].valid()) continue;
+        const int k_x = x[i].k();
+        index->search(x[i], m, osa_bound, prune ? er.n_match_threshold_min(k_x) : 1, candidates, work);
+        for (const nmatch::index_hit& c : candidates) {
+          if (prune && c.n_shared < er.n_match_threshold(k_x, c.name->k())) continue;
+          hits[i].emplace_back();
+          hits[i].back().id = c.id;
+          m.summarize(x[i], *c.name, hits[i].back().summary);
+        }
+      }
+    }, 64);
+  } catch (const std::exception& e) {
+    err = e.what();
+  }
+  if (!err.empty()) Rf_error("%s", err.c_str());
+
+  R_xlen_t total = 0;
+  for (const std::vector<search_hit>& h : hits) total += static_cast<R_xlen_t>(h.size());
+
+  const char* cols[] = {"query", "id", "k_x", "k_y", "k_align", "n_match", "dist_total"};
+  SEXP out = PROTECT(Rf_allocVector(VECSXP, 7));
+  for (int j = 0; j < 7; ++j) {
+    const bool real = j == 1 || (j == 6 && real_dist);
+    SET_VECTOR_ELT(out, j, Rf_allocVector(real ? REALSXP : INTSXP, total));
+  }
+  Rf_setAttrib(out, R_NamesSymbol, mk_names(cols, 7));
+
+  int* query = INTEGER(VECTOR_ELT(out, 0));
+  double* id = REAL(VECTOR_ELT(out, 1));
+  int* k_x = INTEGER(VECTOR_ELT(out, 2));
+  int* k_y = INTEGER(VECTOR_ELT(out, 3));
+  int* k_align = INTEGER(VECTOR_ELT(out, 4));
+  int* n_match = INTEGER(VECTOR_ELT(out, 5));
+  R_xlen_t r = 0;
+  for (std::size_t i = 0; i < n; ++i) {
+    for (const search_hit& h : hits[i]) {
+      query[r] = static_cast<int>(i + 1);
+      id[r] = static_cast<double>(h.id + 1);
+      k_x[r] = h.summary.k_x;
+      k_y[r] = h.summary.k_y;
+      k_align[r] = h.summary.k_align;
+      n_match[r] = h.summary.n_match;
+      if (real_dist) REAL(VECTOR_ELT(out, 6))[r] = h.summary.dist_total;
+      else INTEGER(VECTOR_ELT(out, 6))[r] = static_cast<int>(h.summary.dist_total);
+      ++r;
+    }
+  }
+
+  UNPROTECT(1);
+  return out;
+}
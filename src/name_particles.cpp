@@ -0,0 +1,12 @@
+#include "r_utils.h"
+
+#include <nmatch/particles.h>
+
+// the built-in name particles and titles (see nmatch::name_particles)
+extern "C" SEXP name_particles() {
+  const R_xlen_t n = static_cast<R_xlen_t>(nmatch::n_name_particles);
+  SEXP out = PROTECT(Rf_allocVector(STRSXP, n));
+  for (R_xlen_t i = 0; i < n; ++i) SET_STRING_ELT(out, i, Rf_mkChar(nmatch::name_particles[i]));
+  UNPROTECT(1);
+  return out;
+}
@@ -0,0 +1,32 @@
+#include <cstdio>
+#include <exception>
+
+#include "r_utils.h"
+
+// signature of each tokenized name as a 16-character hex string, or NA for
+// names with no valid tokens
+extern "C" SEXP name_signature(SEXP x_token, SEXP nchar_min) {
+  const R_xlen_t n = Rf_xlength(x_token);
+  const int nchar = Rf_asInteger(nchar_min);
+  SEXP out = PROTECT(Rf_allocVector(STRSXP, n));
+
+  char err[1024] = "";
+  try {
+    nmatch::token_arena arena;
+    const std::vector<nmatch::name_tokens> x = read_names(x_token, nchar, arena);
+    char buf[17];
+    for (R_xlen_t i = 0; i < n; ++i) {
+      if (!x[i].valid()) {
+        SET_STRING_ELT(out, i, NA_STRING);
+        continue;
+      }
+      std::snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(x[i].signature));
+      SET_STRING_ELT(out, i, Rf_mkChar(buf));
+    }
+  } catch (const std::exception& e) {
+    std::snprintf(err, sizeof(err), "%s", e.what());
+  }
+  UNPROTECT(1);
+  if (err[0] != '\0') Rf_error("%s", err);
+  return out;
+}
@@ -0,0 +1,50 @@
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <string>
+
+#include "r_utils.h"
+
+#include <nmatch/standardize.h>
+
+// strings with their Cyrillic, Arabic and Ethiopic letters transliterated to
+// Latin (see nmatch::transliterate()). Strings with none are returned as
+// they are, in their original encoding
+extern "C" SEXP name_translit(SEXP x) {
+  const R_xlen_t n = Rf_xlength(x);
+  SEXP out = PROTECT(Rf_allocVector(STRSXP, n));
+
+  // translate the non-ASCII strings first, as translation may raise an R
+  // error, and leave ASCII and NA strings as they are
+  const char** utf8 = reinterpret_cast<const char**>(R_alloc(n, sizeof(const char*)));
+  for (R_xlen_t i = 0; i < n; ++i) {
+    SEXP s = STRING_ELT(x, i);
+    SET_STRING_ELT(out, i, s);
+    utf8[i] = NULL;
+    if (s == NA_STRING) continue;
+    const char* c = CHAR(s);
+    const std::size_t len = std::strlen(c);
+    bool ascii = true;
+    for (std::size_t k = 0; k < len && ascii; ++k) ascii = static_cast<unsigned char>(c[k]) < 0x80;
+    if (!ascii) utf8[i] = Rf_translateCharUTF8(s);
+  }
+
+  char err[1024] = "";
+  {
+    std::string buf;
+    try {
+      for (R_xlen_t i = 0; i < n; ++i) {
+        if (utf8[i] == NULL) continue;
+        buf.clear();
+        if (!nmatch::transliterate_utf8(utf8[i], std::strlen(utf8[i]), buf)) continue;
+        SET_STRING_ELT(out, i, Rf_mkCharLenCE(buf.data(), static_cast<int>(buf.size()), CE_UTF8));
+      }
+    } catch (const std::exception& e) {
+      std::snprintf(err, sizeof(err), "%s", e.what());
+    }
+  }
+
+  UNPROTECT(1);
+  if (err[0] != '\0') Rf_error("%s", err);
+  return out;
+}
@@ -0,0 +1,69 @@
+#ifndef NMATCH_R_PROFILE_H
+#define NMATCH_R_PROFILE_H
+
+#include "r_utils.h"
+
+#include <nmatch/profile.h>
+
+// profile of a compiled matching call as an R list with elements
+// - stages: list(stage, time_sec, alloc_bytes, allocs), with stage time
+//   summed over threads
+// - events: list(thread, start_us, dur_us, pairs, <stage>_us...), one row per
+//   block of pairs processed by a thread, relative to the start of the call
+inline SEXP profile_sexp(const nmatch::match_profile& p) {
+  const int n_stages = nmatch::N_STAGES;
+  const R_xlen_t n_events = static_cast<R_xlen_t>(p.events.size());
+
+  SEXP stage = PROTECT(Rf_allocVector(STRSXP, n_stages));
+  SEXP time_sec = PROTECT(Rf_allocVector(REALSXP, n_stages));
+  SEXP alloc_bytes = PROTECT(Rf_allocVector(REALSXP, n_stages));
+  SEXP allocs = PROTECT(Rf_allocVector(REALSXP, n_stages));
+  for (int s = 0; s < n_stages; ++s) {
+    SET_STRING_ELT(stage, s, Rf_mkChar(nmatch::stage_name(s)));
+    REAL(time_sec)[s] = p.stage_ns[s] / 1e9;
+    REAL(alloc_bytes)[s] = static_cast<double>(p.alloc_bytes[s]);
+    REAL(allocs)[s] = static_cast<double>(p.allocs[s]);
+  }
+
+  const char* stage_names[] = {"stage", "time_sec", "alloc_bytes", "allocs"};
+  SEXP stages = PROTECT(Rf_allocVector(VECSXP, 4));
+  SET_VECTOR_ELT(stages, 0, stage);
+  SET_VECTOR_ELT(stages, 1, time_sec);
+  SET_VECTOR_ELT(stages, 2, alloc_bytes);
+  SET_VECTOR_ELT(stages, 3, allocs);
+  Rf_setAttrib(stages, R_NamesSymbol, mk_names(stage_names, 4));
+
+  const int n_cols = 4 + n_stages;
+  SEXP events = PROTECT(Rf_allocVector(VECSXP, n_cols));
+  SEXP event_names = PROTECT(Rf_allocVector(STRSXP, n_cols));
+  const char* fixed[] = {"thread", "start_us", "dur_us", "pairs"};
+  for (int j = 0; j < n_cols; ++j) {
+    SET_VECTOR_ELT(events, j, Rf_allocVector(REALSXP, n_events));
+    if (j < 4) {
+      SET_STRING_ELT(event_names, j, Rf_mkChar(fixed[j]));
+    } else {
+      std::string name = std::string(nmatch::stage_name(j - 4)) + "_us";
+      SET_STRING_ELT(event_names, j, Rf_mkChar(name.c_str()));
+    }
+  }
+  Rf_setAttrib(events, R_NamesSymbol, event_names);
+  for (R_xlen_t i = 0; i < n_events; ++i) {
+    const nmatch::trace_event& e = p.events[i];
+    REAL(VECTOR_ELT(events, 0))[i] = e.thread;
+    REAL(VECTOR_ELT(events, 1))[i] = e.start_us;
+    REAL(VECTOR_ELT(events, 2))[i] = e.dur_us;
+    REAL(VECTOR_ELT(events, 3))[i] = static_cast<double>(e.pairs);
+    for (int s = 0; s < n_stages; ++s) REAL(VECTOR_ELT(events, 4 + s))[i] = e.stage_us[s];
+  }
+
+  const char* out_names[] = {"stages", "events"};
+  SEXP out = PROTECT(Rf_allocVector(VECSXP, 2));
+  SET_VECTOR_ELT(out, 0, stages);
+  SET_VECTOR_ELT(out, 1, events);
+  Rf_setAttrib(out, R_NamesSymbol, mk_names(out_names, 2));
+
+  UNPROTECT(8);
+  return out;
+}
+
+#endif
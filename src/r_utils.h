@@ -0,0 +1,187 @@
+#ifndef NMATCH_R_UTILS_H
+#define NMATCH_R_UTILS_H
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#define R_NO_REMAP
+#include <R.h>
+#include <Rinternals.h>
+
+#include <nmatch/aliases.h>
+#include <nmatch/frequency.h>
+#include <nmatch/particles.h>
+#include <nmatch/tokens.h>
+#include <nmatch/weighted.h>
+
+// element of a named list, or R_NilValue if absent
+inline SEXP list_elt(SEXP list, const char* name) {
+  SEXP names = Rf_getAttrib(list, R_NamesSymbol);
+  if (names == R_NilValue) return R_NilValue;
+  for (R_xlen_t i = 0; i < Rf_xlength(list); ++i) {
+    if (std::strcmp(CHAR(STRING_ELT(names, i)), name) == 0) return VECTOR_ELT(list, i);
+  }
+  return R_NilValue;
+}
+
+inline int list_int(SEXP list, const char* name, int default_value) {
+  SEXP x = list_elt(list, name);
+  return x == R_NilValue ? default_value : Rf_asInteger(x);
+}
+
+inline double list_double(SEXP list, const char* name, double default_value) {
+  SEXP x = list_elt(list, name);
+  return x == R_NilValue ? default_value : Rf_asReal(x);
+}
+
+// number of pairs of names x[i], y[i] to compare, where a single name on
+// either side is compared with every name of the other side (see
+// nmatch::name_block())
+inline R_xlen_t n_pairs(SEXP x, SEXP y) {
+  const R_xlen_t n_x = Rf_xlength(x), n_y = Rf_xlength(y);
+  const R_xlen_t n = n_x == 1 ? n_y : n_x;
+  if (n_y != n && n_y != 1) Rf_error("x and y must have the same number of names, or a single name");
+  return n;
+}
+
+// character vector of names, for use with Rf_setAttrib(x, R_NamesSymbol, .)
+inline SEXP mk_names(const char** names, int n) {
+  SEXP out = PROTECT(Rf_allocVector(STRSXP, n));
+  for (int i = 0; i < n; ++i) SET_STRING_ELT(out, i, Rf_mkChar(names[i]));
+  UNPROTECT(1);
+  return out;
+}
+
+// copy the operation costs in `costs` (as returned by costs_native() in
+// R/translit_costs.R) into `out`. Leaves `out` at unit costs if costs is NULL
+inline void read_costs(SEXP costs, nmatch::edit_costs& out) {
+  if (costs == R_NilValue) return;
+  const int nn = nmatch::edit_costs::n * nmatch::edit_costs::n;
+  SEXP sub = list_elt(costs, "sub");
+  SEXP digraph = list_elt(costs, "digraph");
+  SEXP digraph_cost = list_elt(costs, "digraph_cost");
+  if (TYPEOF(sub) != REALSXP || Rf_xlength(sub) != nn ||
+      TYPEOF(digraph) != INTSXP || Rf_xlength(digraph) != nn ||
+      TYPEOF(digraph_cost) != REALSXP || Rf_xlength(digraph_cost) != nn) {
+    Rf_error("invalid edit cost tables");
+  }
+  for (int k = 0; k < nn; ++k) {
+    out.sub[k] = REAL(sub)[k];
+    out.digraph[k] = static_cast<std::uint8_t>(INTEGER(digraph)[k]);
+    out.digraph_cost[k] = REAL(digraph_cost)[k];
+  }
+  out.double_letter = list_double(costs, "double_letter", 1.0);
+  out.finalize();
+}
+
+// set up `out` to drop the tokens in `particles` (as returned by
+// particles_native() in R/name_particles.R, which validates them and
+// converts them to UTF-8). Leaves `out` empty if particles is NULL. Meant to
+// be called within the try block of the glue, so reports errors by throwing
+inline void read_token_filter(SEXP particles, nmatch::token_filter& out) {
+  if (particles == R_NilValue) return;
+  SEXP extra = list_elt(particles, "extra");
+  if (TYPEOF(extra) != STRSXP) throw std::invalid_argument("invalid particle list");
+  out.use_builtin(list_int(particles, "builtin", 0) == 1);
+  std::vector<char32_t> work;
+  for (R_xlen_t i = 0; i < Rf_xlength(extra); ++i) {
+    if (STRING_ELT(extra, i) == NA_STRING) continue;
+    const char* s = CHAR(STRING_ELT(extra, i));
+    const std::size_t n = std::strlen(s);
+    work.resize(n);
+    out.add(nmatch::token_view(work.data(), nmatch::utf8_decode(s, n, work.data())));
+  }
+}
+
+// build `out` from the spellings in `aliases` (as returned by
+// aliases_native() in R/name_aliases.R, which validates them and converts
+// them to UTF-8), a list of character vectors alias and canonical. Leaves
+// `out` empty if aliases is NULL. Like read_token_filter(), reports errors by
+// throwing
+inline void read_aliases(SEXP aliases, nmatch::alias_trie& out) {
+  if (aliases == R_NilValue) return;
+  SEXP alias = list_elt(aliases, "alias");
+  SEXP canonical = list_elt(aliases, "canonical");
+  if (TYPEOF(alias) != STRSXP || TYPEOF(canonical) != STRSXP ||
+      Rf_xlength(alias) != Rf_xlength(canonical)) {
+    throw std::invalid_argument("invalid alias dictionary");
+  }
+  for (R_xlen_t i = 0; i < Rf_xlength(alias); ++i) {
+    if (STRING_ELT(alias, i) == NA_STRING || STRING_ELT(canonical, i) == NA_STRING) continue;
+    const char* a = CHAR(STRING_ELT(alias, i));
+    const char* c = CHAR(STRING_ELT(canonical, i));
+    out.add(nmatch::utf8_decode(a, std::strlen(a)), nmatch::utf8_decode(c, std::strlen(c)));
+  }
+  out.build();
+}
+
+// bytes of the (non-NA) strings of a list of character vectors, an upper
+// bound on their number of codepoints
+inline std::size_t token_bytes(SEXP x) {
+  std::size_t n = 0;
+  for (R_xlen_t i = 0; i < Rf_xlength(x); ++i) {
+    SEXP tokens = VECTOR_ELT(x, i);
+    for (R_xlen_t j = 0; j < Rf_xlength(tokens); ++j) {
+      SEXP token = STRING_ELT(tokens, j);
+      if (token != NA_STRING) n += LENGTH(token);
+    }
+  }
+  return n;
+}
+
+// number of tokens of a list of character vectors
+inline std::size_t token_count(SEXP x) {
+  std::size_t n = 0;
+  for (R_xlen_t i = 0; i < Rf_xlength(x); ++i) n += Rf_xlength(VECTOR_ELT(x, i));
+  return n;
+}
+
+// convert a list of character vectors (as returned by strsplit()) into
+// tokenized names, keeping only tokens with at least nchar_min characters.
+// With `initials`, single letters are kept as initials whatever nchar_min.
+// Tokens in `drop` (e.g. name particles) are left out altogether, and the
+// others replaced by their canonical spelling in `aliases`, if any (which
+// must then outlive the names too). The tokens of each name are counted into
+// `freq`, if not null, as the name is read.
+// The codepoints of all tokens are stored in `arena`, reserved up front so
+// that they take a single allocation, which must outlive the names
+inline std::vector<nmatch::name_tokens> read_names(SEXP x, int nchar_min, nmatch::token_arena& arena,
+                                                   bool initials = false,
+                                                   const nmatch::token_filter* drop = nullptr,
+                                                   const nmatch::alias_trie* aliases = nullptr,
+                                                   nmatch::token_frequencies* freq = nullptr) {
+  const R_xlen_t n = Rf_xlength(x);
+  arena.reserve(token_bytes(x));
+
+  std::vector<nmatch::name_tokens> out(n);
+  for (R_xlen_t i = 0; i < n; ++i) {
+    SEXP tokens = VECTOR_ELT(x, i);
+    out[i].tokens.reserve(Rf_xlength(tokens));
+    for (R_xlen_t j = 0; j < Rf_xlength(tokens); ++j) {
+      SEXP token = STRING_ELT(tokens, j);
+      if (token == NA_STRING) continue;
+      const char* s = Rf_translateCharUTF8(token);
+      nmatch::token_view t = arena.store_utf8(s, std::strlen(s));
+      if (drop && drop->contains(t)) {
+        arena.pop(t);
+        continue;
+      }
+      if (aliases) {
+        const nmatch::token_view c = aliases->canonical(t);
+        if (c.data() != t.data()) {
+          arena.pop(t);
+          t = c;
+        }
+      }
+      if ((initials && out[i].add_initial(t)) || !out[i].add(t, nchar_min)) arena.pop(t);
+    }
+    out[i].finalize();
+    if (freq) freq->add_name(out[i]);
+  }
+  return out;
+}
+
+#endif
@@ -0,0 +1,248 @@
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "r_utils.h"
+
+#include <nmatch/index.h>
+#include <nmatch/server.h>
+
+// defined in name_index.cpp
+std::shared_ptr<nmatch::name_index> index_shared(SEXP ptr);
+
+#ifndef _WIN32
+
+static void server_finalize(SEXP ptr) {
+  // stopping joins the server threads
+  delete static_cast<nmatch::match_server*>(R_ExternalPtrAddr(ptr));
+  R_ClearExternalPtr(ptr);
+}
+
+static nmatch::match_server* server_get(SEXP ptr) {
+  if (TYPEOF(ptr) != EXTPTRSXP) Rf_error("not a name index server");
+  nmatch::match_server* server = static_cast<nmatch::match_server*>(R_ExternalPtrAddr(ptr));
+  if (server == NULL) Rf_error("name index server is no longer available");
+  return server;
+}
+
+// serve the name index `index_ptr` on a Unix domain socket at `path` (see
+// inst/include/nmatch/server.h for the wire format). params as for
+// index_search(), and `rule` a list(kind, param) as for match_pairs().
+// Returns an external pointer that stops the server when garbage collected
+extern "C" SEXP server_start(SEXP index_ptr, SEXP path, SEXP params, SEXP rule) {
+  nmatch::server_config config;
+  config.nchar_min = list_int(params, "nchar_min", 2);
+  config.params.dist_max = list_double(params, "dist_max", 1.0);
+  config.params.method = static_cast<nmatch::dist_method>(list_int(params, "method", nmatch::DIST_OSA));
+  config.params.jw_p = list_double(params, "jw_p", 0.0);
+  read_costs(list_elt(params, "costs"), config.costs);
+  config.rule.kind = static_cast<nmatch::rule_kind>(list_int(rule, "kind", 0));
+  config.rule.param = list_double(rule, "param", 0.0);
+  config.osa_bound = config.params.method == nmatch::DIST_OSA && config.params.dist_max >= 0
+    ? static_cast<int>(std::floor(std::min(config.params.dist_max, 1e6))) : -1;
+
+  // translated into R-allocated memory, and the message copied out of the
+  // exception, so no C++ object is live when Rf_error() jumps
+  const char* p = Rf_translateCharUTF8(STRING_ELT(path, 0));
+  nmatch::match_server* server = nullptr;
+  char err[1024] = "";
+  {
+    std::shared_ptr<nmatch::name_index> index = index_shared(index_ptr);
+    try {
+      server = new nmatch::match_server(std::move(index), config);
+      server->start(p);
+    } catch (const std::exception& e) {
+      delete server;
+      server = nullptr;
+      std::snprintf(err, sizeof(err), "%s", e.what());
+    }
+  }
+  if (err[0] != '\0') Rf_error("cannot start server at '%s': %s", p, err);
+
+  SEXP ptr = PROTECT(R_MakeExternalPtr(server, R_NilValue, R_NilValue));
+  R_RegisterCFinalizerEx(ptr, server_finalize, TRUE);
+  UNPROTECT(1);
+  return ptr;
+}
+
+extern "C" SEXP server_stop(SEXP ptr) {
+  server_get(ptr)->stop();
+  return R_NilValue;
+}
+
+// running (0/1) and number of requests answered
+extern "C" SEXP server_info(SEXP ptr) {
+  const nmatch::match_server* server = server_get(ptr);
+  const char* names[] = {"running", "requests"};
+  SEXP out = PROTECT(Rf_allocVector(REALSXP, 2));
+  REAL(out)[0] = server->running() ? 1.0 : 0.0;
+  REAL(out)[1] = static_cast<double>(server->n_requests());
+  Rf_setAttrib(out, R_NamesSymbol, mk_names(names, 2));
+  UNPROTECT(1);
+  return out;
+}
+
+namespace {
+
+struct client_hit {
+  int query;
+  double id;  // NA for MATCH responses
+  int is_match;
+  int fields[4];
+  double dist_total;
+};
+
+// parse the tab-separated summary fields k_x, k_y, k_align, n_match and
+// dist_total starting at `s`
+bool parse_summary(const char* s, client_hit& h) {
+  char* end;
+  for (int j = 0; j < 4; ++j) {
+    h.fields[j] = static_cast<int>(std::strtol(s, &end, 10));
+    if (end == s || *end != '\t') return false;
+    s = end + 1;
+  }
+  if (std::strcmp(s, "NA") == 0) {
+    h.dist_total = NA_REAL;
+    return true;
+  }
+  h.dist_total = std::strtod(s, &end);
+  return end != s && *end == '\0';
+}
+
+} // namespace
+
+// client: send one request per name (SEARCH for each of x, or MATCH for each
+// pair of x and y if y is not NULL) over a single connection to the server
+// at `path`, pipelining all requests, and parse the responses into a list of
+// columns query (1-based position in x), id (1-based record id, for SEARCH),
+// is_match (for MATCH), k_x, k_y, k_align, n_match and dist_total
+extern "C" SEXP client_request(SEXP path, SEXP x, SEXP y) {
+  const char* p = Rf_translateCharUTF8(STRING_ELT(path, 0));
+  const R_xlen_t n = Rf_xlength(x);
+  const bool search = y == R_NilValue;
+
+  // errors are collected into `err` and raised once the C++ objects below
+  // are destroyed; x and y come from enc2utf8(), so CHAR() needs no
+  // translation that could itself fail
+  SEXP out = R_NilValue;
+  char err[1024] = "";
+  {
+    // names may not contain the field and line separators of the protocol
+    std::string req;
+    for (R_xlen_t i = 0; i < n; ++i) {
+      const char* xi = STRING_ELT(x, i) == NA_STRING ? "" : CHAR(STRING_ELT(x, i));
+      const char* yi = search || STRING_ELT(y, i) == NA_STRING ? "" : CHAR(STRING_ELT(y, i));
+      if (std::strpbrk(xi, "\t\r\n") != NULL || std::strpbrk(yi, "\t\r\n") != NULL) {
+        std::snprintf(err, sizeof(err), "names cannot contain tabs or line breaks (name %d)", static_cast<int>(i + 1));
+        break;
+      }
+      req += search ? "SEARCH\t" : "MATCH\t";
+      req += xi;
+      if (!search) {
+        req += '\t';
+        req += yi;
+      }
+      req += '\n';
+    }
+
+    std::vector<client_hit> hits;
+    const int fd = err[0] == '\0' ? nmatch::socket_connect(p) : -1;
+    if (err[0] == '\0' && fd < 0) {
+      std::snprintf(err, sizeof(err), "cannot connect to server at '%s': %s", p, std::strerror(errno));
+    }
+    if (fd >= 0) {
+      try {
+        // responses are read as the requests are sent
+        nmatch::line_reader reader(fd);
+        reader.send_while_reading(std::move(req));
+        std::string line;
+        for (R_xlen_t i = 0; i < n;) {
+          if (!reader.next(line)) throw std::runtime_error("connection lost");
+          client_hit h;
+          h.query = static_cast<int>(i + 1);
+          if (line.compare(0, 4, "ERR\t") == 0) throw std::runtime_error(line.substr(4));
+          if (search) {
+            if (line == "END") {
+              ++i;
+              continue;
+            }
+            if (line.compare(0, 4, "HIT\t") != 0) throw std::runtime_error("invalid response: " + line);
+            char* end;
+            h.id = std::strtod(line.c_str() + 4, &end);
+            h.is_match = 1;
+            if (h.id <= 0 || *end != '\t' || !parse_summary(end + 1, h)) {
+              throw std::runtime_error("invalid response: " + line);
+            }
+          } else {
+            h.id = NA_REAL;
+            if (line.size() < 9 || line.compare(0, 6, "MATCH\t") != 0 || line[7] != '\t' ||
+                !parse_summary(line.c_str() + 8, h)) {
+              throw std::runtime_error("invalid response: " + line);
+            }
+            h.is_match = line[6] == '1';
+            ++i;
+          }
+          hits.push_back(h);
+        }
+      } catch (const std::exception& e) {
+        std::snprintf(err, sizeof(err), "%s", e.what());
+      }
+      ::close(fd);
+    }
+
+    if (err[0] == '\0') {
+      const R_xlen_t total = static_cast<R_xlen_t>(hits.size());
+      const char* cols[] = {"query", search ? "id" : "is_match", "k_x", "k_y", "k_align", "n_match", "dist_total"};
+      out = PROTECT(Rf_allocVector(VECSXP, 7));
+      SET_VECTOR_ELT(out, 0, Rf_allocVector(INTSXP, total));
+      SET_VECTOR_ELT(out, 1, Rf_allocVector(search ? REALSXP : LGLSXP, total));
+      for (int j = 2; j < 6; ++j) SET_VECTOR_ELT(out, j, Rf_allocVector(INTSXP, total));
+      SET_VECTOR_ELT(out, 6, Rf_allocVector(REALSXP, total));
+      Rf_setAttrib(out, R_NamesSymbol, mk_names(cols, 7));
+
+      for (R_xlen_t r = 0; r < total; ++r) {
+        const client_hit& h = hits[r];
+        INTEGER(VECTOR_ELT(out, 0))[r] = h.query;
+        if (search) REAL(VECTOR_ELT(out, 1))[r] = h.id;
+        else LOGICAL(VECTOR_ELT(out, 1))[r] = h.is_match;
+        for (int j = 0; j < 4; ++j) INTEGER(VECTOR_ELT(out, j + 2))[r] = h.fields[j];
+        REAL(VECTOR_ELT(out, 6))[r] = h.dist_total;
+      }
+      UNPROTECT(1);
+    }
+  }
+  if (err[0] != '\0') Rf_error("%s", err);
+  return out;
+}
+
+#else
+
+extern "C" SEXP server_start(SEXP index_ptr, SEXP path, SEXP params, SEXP rule) {
+  Rf_error("the name index server requires Unix domain sockets, unavailable on Windows");
+  return R_NilValue;
+}
+
+extern "C" SEXP server_stop(SEXP ptr) {
+  Rf_error("the name index server requires Unix domain sockets, unavailable on Windows");
+  return R_NilValue;
+}
+
+extern "C" SEXP server_info(SEXP ptr) {
+  Rf_error("the name index server requires Unix domain sockets, unavailable on Windows");
+  return R_NilValue;
+}
+
+extern "C" SEXP client_request(SEXP path, SEXP x, SEXP y) {
+  Rf_error("the name index server requires Unix domain sockets, unavailable on Windows");
+  return R_NilValue;
+}
+
+#endif
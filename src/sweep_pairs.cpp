@@ -0,0 +1,87 @@
+#include <exception>
+#include <string>
+
+#include "r_utils.h"
+
+#include <nmatch/engine.h>
+#include <nmatch/parallel.h>
+
+// evaluate match_eval() for pairs x[i], y[i] (or a single name x or y with
+// every name of the other side) over a grid of dist_max and n_match_crit
+// values. Token distances and alignments are computed once per pair; each
+// grid cell only recounts the matching aligned tokens. Returns a
+// logical array of dimension n x length(dist_max) x length(n_match_crit)
+extern "C" SEXP sweep_pairs(SEXP x_token, SEXP y_token, SEXP params,
+                            SEXP dist_max, SEXP n_match_crit) {
+  const std::size_t n = static_cast<std::size_t>(n_pairs(x_token, y_token));
+
+  const int nchar_min = list_int(params, "nchar_min", 2);
+  const int n_threads = list_int(params, "threads", 1);
+  const int n_dist = Rf_length(dist_max);
+  const int n_crit = Rf_length(n_match_crit);
+  const double* dm = REAL(dist_max);
+  const double* crit = REAL(n_match_crit);
+  nmatch::edit_costs costs;
+  read_costs(list_elt(params, "costs"), costs);
+  SEXP particles_sexp = list_elt(params, "particles");
+  SEXP aliases_sexp = list_elt(params, "aliases");
+
+  SEXP out = PROTECT(Rf_alloc3DArray(LGLSXP, static_cast<int>(n), n_dist, n_crit));
+  int* is_match = LOGICAL(out);
+
+  std::string err;
+  try {
+    nmatch::token_filter particles;
+    read_token_filter(particles_sexp, particles);
+    const nmatch::token_filter* drop = particles.empty() ? nullptr : &particles;
+    nmatch::alias_trie aliases;
+    read_aliases(aliases_sexp, aliases);
+    const nmatch::alias_trie* canon = aliases.empty() ? nullptr : &aliases;
+
+    nmatch::token_arena arena;
+    arena.reserve(token_bytes(x_token) + token_bytes(y_token));
+    const std::vector<nmatch::name_tokens> x = read_names(x_token, nchar_min, arena, false, drop, canon);
+    const std::vector<nmatch::name_tokens> y = read_names(y_token, nchar_min, arena, false, drop, canon);
+
+    // dist_max only matters for n_match, which aligned_dists() ignores
+    nmatch::match_params mp;
+    mp.dist_max = 0.0;
+    mp.simd = list_int(params, "simd", 1) == 1;
+    mp.method = static_cast<nmatch::dist_method>(list_int(params, "method", nmatch::DIST_OSA));
+    mp.jw_p = list_double(params, "jw_p", 0.0);
+    mp.costs = &costs;
+    std::vector<nmatch::matcher> matchers(n_threads, nmatch::matcher(mp));
+
+    nmatch::parallel_for(n, n_threads, [&](int thread, std::size_t begin, std::size_t end) {
+      nmatch::matcher& m = matchers[thread];
+      nmatch::pair_summary s;
+      nmatch::eval_rule rule;
+      rule.kind = nmatch::RULE_MATCH_EVAL;
+
+      const nmatch::name_seq xs = nmatch::name_block(x, begin), ys = nmatch::name_block(y, begin);
+      m.aligned_dists_block(xs, ys, end - begin,
+                            [&](std::size_t j, bool valid, const std::vector<double>& d) {
+        const std::size_t i = begin + j;
+        s.valid = valid;
+        s.k_x = xs[j].k();
+        s.k_y = ys[j].k();
+        s.k_align = static_cast<int>(d.size());
+        for (int a = 0; a < n_dist; ++a) {
+          // aligned distances are ascending, so n_match is a prefix length
+          s.n_match = 0;
+          while (s.n_match < static_cast<int>(d.size()) && d[s.n_match] <= dm[a]) ++s.n_match;
+          for (int b = 0; b < n_crit; ++b) {
+            rule.param = crit[b];
+            is_match[i + n * (a + static_cast<std::size_t>(n_dist) * b)] = rule(s);
+          }
+        }
+      });
+    });
+  } catch (const std::exception& e) {
+    err = e.what();
+  }
+
+  UNPROTECT(1);
+  if (!err.empty()) Rf_error("%s", err.c_str());
+  return out;
+}
@@ -0,0 +1,245 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+#include "r_utils.h"
+
+// Synthetic name pairs for benchmarking. People are drawn from pools of
+// surnames and given names; for matching pairs, the second name is a copy of
+// the first with random corruptions of the kinds seen between registries
+// (typos, name order, accents, punctuation, dropped middle names)
+
+namespace {
+
+using nmatch::token_t;
+
+struct synth_probs {
+  double match;
+  double typo;
+  double swap;
+  double accent;
+  double punct;
+  double drop;
+};
+
+struct person {
+  std::vector<token_t> given;
+  std::vector<token_t> surname;
+};
+
+// Latin-1 letters with and without accent
+const char32_t accent_pairs[][2] = {
+  {U'A', 0xC0}, {U'A', 0xC2}, {U'C', 0xC7}, {U'E', 0xC8}, {U'E', 0xC9},
+  {U'E', 0xCA}, {U'E', 0xCB}, {U'I', 0xCE}, {U'I', 0xCF}, {U'O', 0xD4},
+  {U'O', 0xD6}, {U'U', 0xD9}, {U'U', 0xDB}, {U'U', 0xDC},
+  {U'a', 0xE0}, {U'a', 0xE2}, {U'c', 0xE7}, {U'e', 0xE8}, {U'e', 0xE9},
+  {U'e', 0xEA}, {U'e', 0xEB}, {U'i', 0xEE}, {U'i', 0xEF}, {U'o', 0xF4},
+  {U'o', 0xF6}, {U'u', 0xF9}, {U'u', 0xFB}, {U'u', 0xFC}
+};
+const int n_accent_pairs = sizeof(accent_pairs) / sizeof(accent_pairs[0]);
+
+char32_t to_upper(char32_t c) {
+  if (c >= U'a' && c <= U'z') return c - 0x20;
+  if (c >= 0xE0 && c <= 0xFE && c != 0xF7) return c - 0x20;
+  return c;
+}
+
+class name_synth {
+public:
+  name_synth(std::vector<token_t> surnames, std::vector<token_t> given,
+             const synth_probs& p, std::uint64_t seed)
+    : surnames_(std::move(surnames)), given_(std::move(given)), p_(p), rng_(seed) {}
+
+  person draw() {
+    person out;
+    const int n_given = 1 + (chance(0.5) ? 1 : 0) + (chance(0.15) ? 1 : 0);
+    for (int i = 0; i < n_given; ++i) out.given.push_back(pick(given_));
+    out.surname.push_back(pick(surnames_));
+    if (chance(0.1)) out.surname.push_back(pick(surnames_));
+    return out;
+  }
+
+  // "Given Middle Surname"
+  std::string format(const person& x) {
+    std::string out;
+    for (const token_t& t : x.given) append(out, t, " ");
+    for (const token_t& t : x.surname) append(out, t, " ");
+    return out;
+  }
+
+  std::string corrupt(person x) {
+    if (chance(p_.drop) && x.given.size() > 1) x.given.resize(1);
+    if (chance(p_.typo)) typo(random_token(x));
+    if (chance(p_.accent)) accent(random_token(x));
+
+    // middle names abbreviated to an initial
+    const bool initials = x.given.size() > 1 && chance(p_.punct);
+
+    std::string out;
+    const bool swap = chance(p_.swap);
+    if (swap) {
+      // "SURNAME, Given M."
+      for (token_t t : x.surname) {
+        for (char32_t& c : t) c = to_upper(c);
+        append(out, t, " ");
+      }
+      out += ",";
+    }
+    for (std::size_t i = 0; i < x.given.size(); ++i) {
+      if (initials && i > 0) {
+        append(out, token_t(1, x.given[i][0]), " ");
+        out += ".";
+      } else {
+        append(out, x.given[i], " ");
+      }
+    }
+    if (!swap) for (const token_t& t : x.surname) append(out, t, " ");
+
+    // separators replaced by dashes or underscores, or doubled
+    if (chance(p_.punct)) {
+      std::size_t pos = out.find(' ');
+      if (pos != std::string::npos) {
+        const char* sep[] = {"-", "_", "  ", " - "};
+        out.replace(pos, 1, sep[rng_() % 4]);
+      }
+    }
+    return out;
+  }
+
+  bool chance(double p) { return unif_(rng_) < p; }
+
+private:
+  static void append(std::string& out, const token_t& t, const char* sep) {
+    if (!out.empty()) out += sep;
+    out += nmatch::utf8_encode(t);
+  }
+
+  const token_t& pick(const std::vector<token_t>& pool) {
+    return pool[rng_() % pool.size()];
+  }
+
+  token_t& random_token(person& x) {
+    const std::size_t k = x.given.size() + x.surname.size();
+    const std::size_t i = rng_() % k;
+    return i < x.given.size() ? x.given[i] : x.surname[i - x.given.size()];
+  }
+
+  // a single substitution, insertion, deletion or adjacent transposition
+  void typo(token_t& t) {
+    if (t.size() < 2) return;
+    const std::size_t i = rng_() % t.size();
+    const char32_t letter = (t[i] >= U'a' && t[i] <= U'z' ? U'a' : U'A') + rng_() % 26;
+    switch (rng_() % 4) {
+    case 0: t[i] = letter; break;
+    case 1: t.insert(t.begin() + i, letter); break;
+    case 2: t.erase(t.begin() + i); break;
+    default:
+      if (i + 1 < t.size()) std::swap(t[i], t[i + 1]);
+      else std::swap(t[i - 1], t[i]);
+    }
+  }
+
+  // strip the first accented letter, or accent the first letter that can be
+  void accent(token_t& t) {
+    for (char32_t& c : t) {
+      for (int k = 0; k < n_accent_pairs; ++k) {
+        if (c == accent_pairs[k][1]) { c = accent_pairs[k][0]; return; }
+      }
+    }
+    for (char32_t& c : t) {
+      int first = -1, n = 0;
+      for (int k = 0; k < n_accent_pairs; ++k) {
+        if (c != accent_pairs[k][0]) continue;
+        if (first < 0) first = k;
+        ++n;
+      }
+      if (n > 0) {
+        c = accent_pairs[first + rng_() % n][1];
+        return;
+      }
+    }
+  }
+
+  std::vector<token_t> surnames_;
+  std::vector<token_t> given_;
+  synth_probs p_;
+  std::mt19937_64 rng_;
+  std::uniform_real_distribution<double> unif_;
+};
+
+// x from enc2utf8(), so CHAR() is UTF-8
+std::vector<token_t> read_pool(SEXP x) {
+  std::vector<token_t> out;
+  for (R_xlen_t i = 0; i < Rf_xlength(x); ++i) {
+    SEXP s = STRING_ELT(x, i);
+    if (s == NA_STRING) continue;
+    const char* c = CHAR(s);
+    out.push_back(nmatch::utf8_decode(c, std::strlen(c)));
+  }
+  return out;
+}
+
+SEXP mk_utf8(const std::string& x) {
+  return Rf_mkCharLenCE(x.data(), static_cast<int>(x.size()), CE_UTF8);
+}
+
+} // namespace
+
+// n synthetic pairs of names, returned as list(x, y, is_match)
+extern "C" SEXP synth_pairs(SEXP n, SEXP surnames, SEXP given, SEXP probs, SEXP seed) {
+  const R_xlen_t n_pairs = static_cast<R_xlen_t>(Rf_asReal(n));
+
+  synth_probs p;
+  p.match = list_double(probs, "match", 0.5);
+  p.typo = list_double(probs, "typo", 0.3);
+  p.swap = list_double(probs, "swap", 0.5);
+  p.accent = list_double(probs, "accent", 0.2);
+  p.punct = list_double(probs, "punct", 0.2);
+  p.drop = list_double(probs, "drop", 0.3);
+
+  const std::uint64_t seed_value = static_cast<std::uint64_t>(Rf_asReal(seed));
+
+  SEXP out = PROTECT(Rf_allocVector(VECSXP, 3));
+  SEXP x = PROTECT(Rf_allocVector(STRSXP, n_pairs));
+  SEXP y = PROTECT(Rf_allocVector(STRSXP, n_pairs));
+  SEXP is_match = PROTECT(Rf_allocVector(LGLSXP, n_pairs));
+
+  char err[1024] = "";
+  try {
+    std::vector<token_t> s_pool = read_pool(surnames), g_pool = read_pool(given);
+    if (s_pool.empty() || g_pool.empty()) {
+      throw std::invalid_argument("surnames and given names must not be empty");
+    }
+    name_synth synth(std::move(s_pool), std::move(g_pool), p, seed_value);
+
+    for (R_xlen_t i = 0; i < n_pairs; ++i) {
+      const person a = synth.draw();
+      const bool match = synth.chance(p.match);
+      SET_STRING_ELT(x, i, mk_utf8(synth.format(a)));
+      SET_STRING_ELT(y, i, mk_utf8(synth.corrupt(match ? a : synth.draw())));
+      LOGICAL(is_match)[i] = match;
+    }
+  } catch (const std::exception& e) {
+    std::snprintf(err, sizeof(err), "%s", e.what());
+  }
+  if (err[0] != '\0') {
+    UNPROTECT(4);
+    Rf_error("%s", err);
+  }
+
+  SET_VECTOR_ELT(out, 0, x);
+  SET_VECTOR_ELT(out, 1, y);
+  SET_VECTOR_ELT(out, 2, is_match);
+  SEXP names = PROTECT(Rf_allocVector(STRSXP, 3));
+  SET_STRING_ELT(names, 0, Rf_mkChar("x"));
+  SET_STRING_ELT(names, 1, Rf_mkChar("y"));
+  SET_STRING_ELT(names, 2, Rf_mkChar("is_match"));
+  Rf_setAttrib(out, R_NamesSymbol, names);
+
+  UNPROTECT(5);
+  return out;
+}